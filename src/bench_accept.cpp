@@ -0,0 +1,186 @@
+// Connect-burst benchmark: opens connections to a server on localhost all at once, each sending a
+// request as soon as it's established, and times how long it takes for them all to be answered.
+// Under a burst, a listener that takes one connection per wakeup, or has a short backlog, drops
+// SYNs, and the connections they were of wait for the client to retransmit them (a second or more).
+//
+// usage: bench_accept [connections=2000] [accept_budget=64] [backlog=SOMAXCONN] [rounds=5]
+//
+// Connections not answered within a round's deadline are counted as failed.
+
+#include <algorithm>
+#include <array>
+#include <arpa/inet.h>
+#include <chrono>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "server.h"
+#include "vocabserv.h"
+
+namespace sc = std::chrono;
+
+detail::log g_log;
+detail::vocab g_vocab;
+const char *g_wwwroot = ".";
+
+namespace
+{
+constexpr uint16_t port            = 3704;
+constexpr auto deadline            = sc::seconds{10}; // of a round
+// answered with a 401, which closes the connection; neither credentials nor files are looked up
+constexpr std::string_view request = "GET / HTTP/1.1\r\nconnection: close\r\n\r\n";
+
+sockaddr_in localhost() noexcept
+{
+    sockaddr_in sa{};
+    sa.sin_family      = AF_INET;
+    sa.sin_port        = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sa;
+}
+
+//! @brief Waits for the server to have begun listening
+void await_listening()
+{
+    const auto sa = localhost();
+    for (;;) {
+        const auto fd = CHECK(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0), != -1);
+        const auto ok = connect(fd, reinterpret_cast<const sockaddr *>(&sa), sizeof(sa)) == 0;
+        close(fd);
+        if (ok) return;
+        std::this_thread::sleep_for(sc::milliseconds{10});
+    }
+}
+
+double ms_since(const sc::steady_clock::time_point t) noexcept
+{
+    return sc::duration<double, std::milli>{sc::steady_clock::now() - t}.count();
+}
+
+struct round_result {
+    double wall;            // ms
+    std::vector<double> ms; // of each connection answered, from its connect() to the EOF after
+    unsigned failed = 0;    // refused, reset, or not answered in time
+};
+
+//! @brief Opens n connections at once, and waits for each of them to be answered and closed
+round_result burst(const unsigned n)
+{
+    struct conn {
+        int fd;
+        sc::steady_clock::time_point t0;
+    };
+    std::vector<conn> cs(n);
+    round_result r;
+    r.ms.reserve(n);
+    const auto ep = CHECK(epoll_create1(EPOLL_CLOEXEC), != -1);
+    const auto sa = localhost();
+    const auto t0 = sc::steady_clock::now();
+    for (unsigned i = 0; i < n; ++i) {
+        auto &c = cs[i];
+        c.fd    = CHECK(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), != -1);
+        c.t0    = sc::steady_clock::now();
+        if (connect(c.fd, reinterpret_cast<const sockaddr *>(&sa), sizeof(sa)) == -1 &&
+            errno != EINPROGRESS) {
+            close(c.fd), c.fd = -1, ++r.failed;
+            continue;
+        }
+        epoll_event ev{.events = EPOLLOUT, .data = {.u32 = i}};
+        CHECK(epoll_ctl(ep, EPOLL_CTL_ADD, c.fd, &ev), != -1);
+    }
+    std::array<epoll_event, 256> evs;
+    char buf[4096];
+    const auto wait = [&] { // ms until the deadline, for epoll_wait()
+        const auto d = sc::duration_cast<sc::milliseconds>(t0 + deadline - sc::steady_clock::now());
+        return static_cast<int>(std::max<int64_t>(d.count(), 0));
+    };
+    for (auto left = n - r.failed; left;) {
+        const auto m =
+            CHECK(epoll_wait(ep, evs.data(), static_cast<int>(evs.size()), wait()), != -1);
+        if (!m) { // past the deadline
+            for (auto &c : cs)
+                if (c.fd != -1) close(c.fd), c.fd = -1, ++r.failed;
+            break;
+        }
+        for (int j = 0; j < m; ++j) {
+            auto &c         = cs[evs[j].data.u32];
+            const auto done = [&](const bool ok) {
+                if (ok)
+                    r.ms.push_back(ms_since(c.t0));
+                else
+                    ++r.failed;
+                close(c.fd), c.fd = -1, --left;
+            };
+            if (evs[j].events & EPOLLOUT) { // connected, or failed to
+                int err        = 0;
+                socklen_t nerr = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &nerr);
+                if (err || write(c.fd, request.data(), request.size()) !=
+                               static_cast<ssize_t>(request.size())) {
+                    done(false);
+                    continue;
+                }
+                epoll_event ev{.events = EPOLLIN, .data = evs[j].data};
+                CHECK(epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev), != -1);
+                continue;
+            }
+            ssize_t ret;
+            while ((ret = read(c.fd, buf, sizeof(buf))) > 0)
+                ;
+            if (ret == 0 || errno != EAGAIN) done(ret == 0);
+        }
+    }
+    r.wall = ms_since(t0);
+    close(ep);
+    return r;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto arg = [&](const int i, const unsigned def) {
+        return argc > i ? static_cast<unsigned>(strtoul(argv[i], nullptr, 10)) : def;
+    };
+    const auto n      = arg(1, 2000);
+    const auto rounds = arg(4, 5);
+
+    // as many descriptors as the burst takes, on both ends
+    rlimit rl;
+    CHECK(getrlimit(RLIMIT_NOFILE, &rl), != -1);
+    rl.rlim_cur = rl.rlim_max;
+    CHECK(setrlimit(RLIMIT_NOFILE, &rl), != -1);
+
+    g_log.file = CHECK(fopen("/dev/null", "w"), != nullptr);
+    pnen::run_server_options o{};
+    o.hostport      = port;
+    o.accept_budget = arg(2, o.accept_budget);
+    o.backlog       = static_cast<int>(arg(3, static_cast<unsigned>(o.backlog)));
+    std::thread{[o] {
+        pnen::run_server(o, [](auto s) { return handle_connection(std::move(s)); });
+    }}.detach();
+    await_listening();
+
+    setvbuf(stdout, nullptr, _IOLBF, 0); // rounds are shown as they finish
+    printf("%u connections, accept budget %u, backlog %d\n", n, o.accept_budget, o.backlog);
+    for (unsigned i = 0; i < rounds; ++i) {
+        auto r = burst(n);
+        std::ranges::sort(r.ms);
+        const auto pct = [&](const double p) {
+            return r.ms.empty() ? 0. : r.ms[static_cast<std::size_t>(p * (r.ms.size() - 1))];
+        };
+        printf("round %u: %8.1f ms, %8.0f conn/s; latency p50 %7.2f ms, p99 %7.2f ms, max %7.2f "
+               "ms; %u failed\n",
+               i, r.wall, static_cast<double>(r.ms.size()) / (r.wall / 1000), pct(.5), pct(.99),
+               pct(1), r.failed);
+    }
+    fflush(stdout);
+    _exit(0); // the server doesn't stop, nor would its thread be joined
+}
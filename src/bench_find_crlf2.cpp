@@ -0,0 +1,121 @@
+// Header read loop benchmark: has request headers arrive in segments, from a byte at a time to TCP
+// segment sizes, as the read loop of handle_connection() has them, and times finding their
+// CRLFCRLF per header, three ways: rescanning all that's been read for it on each read, as the loop
+// used to, resuming where the last scan left off, and resuming with find_crlf2() instead of a
+// std::ranges::search() for it.
+//
+// usage: bench_find_crlf2 [iterations=20000]
+//
+// Segments are copied into the read buffer as a read() would, which is timed along with the scans.
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench_headers.h"
+#include "message.h"
+#include "server.h"
+#include "vocabserv.h"
+
+namespace sc = std::chrono;
+
+detail::log g_log;
+detail::vocab g_vocab;
+const char *g_wwwroot = ".";
+
+namespace
+{
+constexpr std::string_view crlf2 = "\r\n\r\n";
+// bytes a read takes: a byte at a time (a client typing, or trickling it in on purpose), small
+// writes, the minimum and usual Ethernet MSS, and the whole header at once (0)
+constexpr std::size_t segments[] = {1, 8, 64, 536, 1448, 0};
+
+//! @brief A way of finding the end of a header that's been read into [f:f+nread), given that
+//!        [f:f+scanned) has been scanned for it
+using scan_fn = char *(*)(char *f, std::size_t scanned, std::size_t nread);
+
+char *rescan(char *const f, std::size_t, const std::size_t nread)
+{
+    return std::ranges::search(f, f + nread, crlf2.begin(), crlf2.end()).begin();
+}
+char *resume_search(char *const f, const std::size_t scanned, const std::size_t nread)
+{
+    return std::ranges::search(f + scanned, f + nread, crlf2.begin(), crlf2.end()).begin();
+}
+char *resume_find_crlf2(char *const f, const std::size_t scanned, const std::size_t nread)
+{
+    return find_crlf2(f + scanned, f + nread);
+}
+
+//! @brief Reads hdr into buf seg bytes at a time, scanning it with scan after each read, like the
+//!        read loop does
+//! @return Offset of the CRLFCRLF found
+JUTIL_INLINE std::size_t read_header(const std::string_view hdr, char *const buf,
+                                     const std::size_t seg, const scan_fn scan)
+{
+    std::size_t nread = 0;
+    char *eoh;
+    for (std::size_t scanned = 0; (eoh = scan(buf, scanned, nread)) == buf + nread;) {
+        scanned = nread < 3 ? 0 : nread - 3;
+        const auto n = std::min(seg ? seg : hdr.size(), hdr.size() - nread);
+        memcpy(buf + nread, hdr.data() + nread, n);
+        nread += n;
+    }
+    return static_cast<std::size_t>(eoh - buf);
+}
+
+//! @return ns per header
+double time_reads(const std::string_view hdr, const std::size_t seg, const scan_fn scan,
+                  const unsigned iters)
+{
+    std::vector<char> buf(hdr.size());
+    std::size_t sink = 0; // of the offsets found, so that the scans can't be left out
+    const auto t0    = sc::steady_clock::now();
+    for (unsigned i = 0; i < iters; ++i)
+        sink += read_header(hdr, buf.data(), seg, scan);
+    const auto dt = sc::duration<double, std::nano>{sc::steady_clock::now() - t0}.count();
+    CHECK(sink == iters * (hdr.size() - crlf2.size()));
+    return dt / iters;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto iters = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], nullptr, 10)) : 20000u;
+
+    // the samples, and a request carrying the cookies of a site that sets many of them
+    std::vector<std::pair<std::string, std::string>> hdrs;
+    for (const auto &[name, header] : bench_headers::samples)
+        hdrs.emplace_back(name, header);
+    auto cookies = std::string{bench_headers::samples[1].header};
+    cookies.insert(cookies.size() - 2, "Cookie: ");
+    for (int i = 0; i < 48; ++i) {
+        char c[96];
+        snprintf(c, sizeof(c), "%scookie_%02d=%064x", i ? "; " : "", i, i * 0x9e3779b9u);
+        cookies.insert(cookies.size() - 2, c);
+    }
+    cookies.insert(cookies.size() - 2, "\r\n");
+    hdrs.emplace_back("cookies", std::move(cookies));
+
+    constexpr std::pair<const char *, scan_fn> scans[] = {
+        {"rescan", rescan}, {"resume", resume_search}, {"find_crlf2", resume_find_crlf2}};
+    for (const auto &[name, hdr] : hdrs) {
+        printf("%s (%zu B), ns per header:\n  %-8s", name.c_str(), hdr.size(), "segment");
+        for (const auto &[sname, fn] : scans)
+            printf(" %12s", sname);
+        printf("\n");
+        for (const auto seg : segments) {
+            seg ? printf("  %-8zu", seg) : printf("  %-8s", "all");
+            // a few iterations for short segments, whose rescans take quadratic time
+            const auto n = seg && seg < 64 ? std::max(iters / 20, 1u) : iters;
+            for (const auto &[sname, fn] : scans)
+                printf(" %12.1f", time_reads(hdr, seg, fn, n));
+            printf("\n");
+        }
+    }
+}
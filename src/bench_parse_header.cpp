@@ -0,0 +1,160 @@
+// parse_header() benchmark: times parse_header() against the scalar parser it replaced, on request
+// headers as browsers and tools send them. Either parser scans a header a line at a time; only the
+// scans within a line (of a field name for its colon, and of a value for its CR) differ.
+//
+// usage: bench_parse_header [iterations=1000000]
+//        bench_parse_header check [headers=100000]
+//
+// With check, it instead parses the samples and random headers, mostly well-formed, with both, and
+// fails if they disagree on any of the start line, the fields, or the bytes of the header after.
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+
+#include "bench_headers.h"
+#include "message.h"
+#include "server.h"
+#include "vocabserv.h"
+
+#include "lmacro_begin.h"
+
+namespace sc = std::chrono;
+
+detail::log g_log;
+detail::vocab g_vocab;
+const char *g_wwwroot = ".";
+
+namespace
+{
+using namespace jutil;
+
+constexpr auto phdrws = L(x == ' ' || x == '\t');
+constexpr auto lccnv  = L(to_unsigned(x - 'A') <= to_unsigned('Z' - 'A') ? x + ('a' - 'A') : x);
+
+//! @brief parse_header() as it was before its scans were vectorized, a byte at a time
+void parse_header_scalar(char *f, char *const l, message &msg)
+{
+    auto i = std::find(f, l, '\r');
+    parse_start(f, i, msg.strt);
+    msg.hdrs.clear();
+    l[1] = ':'; // sentinel
+    while (reinterpret_cast<uintptr_t>(i) < reinterpret_cast<uintptr_t>(l)) {
+        f                = i + 2;
+        const auto colon = transform_always_until(f, l + 2, f, L(static_cast<char>(lccnv(x))), ':');
+        const auto val   = find_if_always(colon + 1, l + 2, L(!(phdrws(x))));
+        i                = find_always(val, l + 3, '\r');
+        msg.hdrs.reserve(f, colon, val, i);
+    }
+}
+
+//! @brief Renders what's been parsed of buf into msg, and buf itself, for them to be compared
+std::string dump(const message &msg, const std::string &buf)
+{
+    std::string r = std::to_string(std::to_underlying(msg.strt.mtd)) + ' ' +
+                    std::to_string(std::to_underlying(msg.strt.ver)) + ' ' +
+                    std::string{msg.strt.tgt.p ? msg.strt.tgt.sv() : ""} + '\n';
+    for (std::size_t i = 0; i < std::size(field_names); ++i)
+        if (const auto f = static_cast<field>(i); msg.hdrs.has(f))
+            r += std::string{field_names[i]} + ": " + std::string{msg.hdrs.get(f)} + '\n';
+    for (const auto &[k, v] : msg.hdrs)
+        r += '+' + std::string{k.sv()} + ": " + std::string{v.sv()} + '\n';
+    return r + "--\n" + buf;
+}
+
+//! @brief Parses hdr, followed by data pipelined after it, with both parsers
+//! @return Whether they agree, or hdr doesn't end in a CRLFCRLF
+bool agree(std::string hdr)
+{
+    hdr.append(64, 'Z');
+    auto a = hdr, b = hdr;
+    const auto ea = find_crlf2(a.data(), a.data() + a.size());
+    if (ea == a.data() + a.size()) return true;
+    message ma, mb;
+    parse_header(a.data(), ea, ma);
+    parse_header_scalar(b.data(), b.data() + (ea - a.data()), mb);
+    if (const auto da = dump(ma, a), db = dump(mb, b); da != db) {
+        printf("parsers disagree on:\n%s\n-- parse_header():\n%s\n-- scalar:\n%s\n", hdr.c_str(),
+               da.c_str(), db.c_str());
+        return false;
+    }
+    return true;
+}
+
+//! @brief A random header: up to 8 lines of names, values, colons and whitespace, mostly
+//!        well-formed, but now and then with bare LFs and no colon
+std::string random_header(std::mt19937 &rng)
+{
+    constexpr std::string_view alphabet = "aZ: \t\r\n-x:";
+    std::string h                       = "GET /x HTTP/1.1\r\n";
+    for (auto n = rng() % 8; n--;) {
+        std::string line(rng() % 70, ' ');
+        for (auto &c : line)
+            c = alphabet[rng() % alphabet.size()];
+        const auto wellformed = rng() % 4 != 0;
+        for (auto &c : line)
+            if (c == '\r' || (wellformed && c == '\n')) c = 'y';
+        if (wellformed && line.find(':') == std::string::npos) line += ":v";
+        h += line + "\r\n";
+    }
+    return h + "\r\n";
+}
+
+int check(const unsigned n)
+{
+    auto ok = true;
+    for (const auto &[_, header] : bench_headers::samples)
+        ok &= agree(std::string{header});
+    std::mt19937 rng{7};
+    for (unsigned i = 0; ok && i < n; ++i)
+        ok &= agree(random_header(rng));
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//! @return ns per header
+template <class F>
+double time_parse(const std::string_view header, F parse, const unsigned iters)
+{
+    std::string buf{header};
+    const auto l = find_crlf2(buf.data(), buf.data() + buf.size());
+    message msg;
+    const auto t0 = sc::steady_clock::now();
+    for (unsigned i = 0; i < iters; ++i) {
+        parse(buf.data(), l, msg);
+        asm volatile("" ::: "memory"); // for each parse to be done anew
+    }
+    return sc::duration<double, std::nano>{sc::steady_clock::now() - t0}.count() / iters;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto arg = [&](const int i, const unsigned def) {
+        return argc > i ? static_cast<unsigned>(strtoul(argv[i], nullptr, 10)) : def;
+    };
+    if (argc > 1 && strcmp(argv[1], "check") == 0) return check(arg(2, 100000));
+
+    // the parsers take turns, each keeping its fastest round, for noise to hit both alike
+    constexpr unsigned rounds = 16;
+    constexpr auto simd_parse = [](char *f, char *l, message &msg) { parse_header(f, l, msg); };
+    const auto iters          = std::max(arg(1, 1000000) / rounds, 1u);
+    printf("%-8s %6s %12s %12s %8s\n", "header", "bytes", "scalar ns", "simd ns", "speedup");
+    for (const auto &[name, header] : bench_headers::samples) {
+        auto scalar = HUGE_VAL, simd = HUGE_VAL;
+        for (unsigned r = 0; r < rounds; ++r) {
+            scalar = std::min(scalar, time_parse(header, parse_header_scalar, iters));
+            simd   = std::min(simd, time_parse(header, simd_parse, iters));
+        }
+        printf("%-8.*s %6zu %12.1f %12.1f %7.2fx\n", static_cast<int>(name.size()), name.data(),
+               header.size(), scalar, simd, scalar / simd);
+    }
+}
+
+#include "lmacro_end.h"
@@ -1,5 +1,9 @@
 #include "buffer.h"
 
+#include <algorithm>
+#include <array>
+#include <vector>
+
 template <class ChTy, std::size_t DefCap>
 template <bool Copy>
 void basic_buffer<ChTy, DefCap>::grow(std::size_t n)
@@ -13,3 +17,76 @@ void basic_buffer<ChTy, DefCap>::grow(std::size_t n)
 }
 template void buffer::grow<false>(std::size_t);
 template void buffer::grow<true>(std::size_t);
+
+//
+// pooled_buffer
+//
+
+namespace detail
+{
+// Blocks kept per class; larger classes keep fewer (class 0 keeps up to 4 MiB worth).
+static constexpr std::size_t pool_keep(const unsigned cls) noexcept
+{
+    return std::max(std::size_t{1024} >> cls, std::size_t{1});
+}
+
+thread_local std::array<std::vector<char *>, pooled_buffer::nclasses> t_pool;
+thread_local pool_stats t_pool_stats{};
+thread_local struct pool_reaper {
+    ~pool_reaper()
+    {
+        for (auto &l : t_pool)
+            for (const auto p : l)
+                delete[] p;
+    }
+} t_pool_reaper;
+
+char *pool_alloc(const unsigned cls)
+{
+    (void)t_pool_reaper;
+    auto &l = t_pool[cls];
+    t_pool_stats.held += pooled_buffer::mincap << cls;
+    if (l.empty()) {
+        l.reserve(pool_keep(cls)); // so that pool_free() never reallocates
+        return new char[pooled_buffer::mincap << cls];
+    }
+    const auto p = l.back();
+    l.pop_back();
+    t_pool_stats.kept -= pooled_buffer::mincap << cls;
+    return p;
+}
+
+void pool_free(char *const p, const unsigned cls) noexcept
+{
+    t_pool_stats.held -= pooled_buffer::mincap << cls;
+    if (auto &l = t_pool[cls]; l.size() < pool_keep(cls))
+        l.push_back(p), t_pool_stats.kept += pooled_buffer::mincap << cls;
+    else
+        delete[] p;
+}
+
+pool_stats pool_totals() noexcept { return t_pool_stats; }
+} // namespace detail
+
+bool pooled_buffer::grow(const std::size_t n)
+{
+    if (capacity() == maxcap) return false;
+    const auto p = detail::pool_alloc(cls_ + 1);
+    std::copy_n(p_, n, p);
+    detail::pool_free(p_, cls_++);
+    p_ = p;
+    return true;
+}
+
+void pooled_buffer::shrink(const std::size_t n)
+{
+    auto cls = 0u;
+    while ((mincap << cls) < n)
+        ++cls;
+    if (cls >= cls_) return;
+    const auto p = detail::pool_alloc(cls);
+    std::copy_n(p_, n, p);
+    detail::pool_free(p_, cls_);
+    p_   = p;
+    cls_ = cls;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <bit>
 #include <memory>
 #include <string>
 
@@ -22,6 +23,13 @@ struct basic_buffer {
     // MODIFICATION
     //
     constexpr JUTIL_INLINE void clear() noexcept { n_ = 0; }
+    //! @brief Clears the buffer, also giving back storage grown past defcap
+    JUTIL_INLINE void reset()
+    {
+        n_ = 0;
+        if (cap_ > defcap) [[unlikely]]
+            buf_ = std::make_unique_for_overwrite<ChTy[]>(cap_ = defcap);
+    }
     template <bool Copy>
     void grow(std::size_t n);
 
@@ -55,4 +63,52 @@ struct basic_buffer {
 };
 using buffer = basic_buffer<char, 4096>;
 
+//
+// pooled_buffer
+//
+
+namespace detail
+{
+//! @brief Takes a block of pooled_buffer::mincap << cls bytes from the calling thread's pool
+[[nodiscard]] char *pool_alloc(unsigned cls);
+//! @brief Returns a block taken with pool_alloc() to the calling thread's pool
+void pool_free(char *p, unsigned cls) noexcept;
+
+struct pool_stats {
+    std::size_t held; // bytes of the blocks taken and not yet returned
+    std::size_t kept; // bytes of the blocks returned and kept for reuse
+};
+//! @return The statistics of the calling thread's pool
+[[nodiscard]] pool_stats pool_totals() noexcept;
+} // namespace detail
+
+//! @brief Fixed-capacity byte buffer that can step through power-of-two capacities on demand
+//!
+//! Blocks come from per-thread free lists (one per capacity), so a connection only pays for a
+//! large block while it actually holds a large message.
+struct pooled_buffer {
+    static constexpr std::size_t mincap = 4096;
+    static constexpr std::size_t maxcap = 8 * 1024 * 1024;
+    static constexpr unsigned nclasses  = std::countr_zero(maxcap / mincap) + 1;
+
+    pooled_buffer() : p_{detail::pool_alloc(0)} {}
+    pooled_buffer(const pooled_buffer &)            = delete;
+    pooled_buffer &operator=(const pooled_buffer &) = delete;
+    ~pooled_buffer() { detail::pool_free(p_, cls_); }
+
+    [[nodiscard]] JUTIL_INLINE char *data() const noexcept { return p_; }
+    [[nodiscard]] JUTIL_INLINE std::size_t capacity() const noexcept { return mincap << cls_; }
+
+    //! @brief Doubles the capacity, keeping the first n bytes
+    //! @return Whether the buffer could grow (i.e., wasn't at maxcap already)
+    bool grow(std::size_t n);
+
+    //! @brief Returns to the smallest capacity that fits the first n bytes, keeping them
+    void shrink(std::size_t n);
+
+  private:
+    char *p_;
+    unsigned cls_ = 0;
+};
+
 #include "lmacro_end.h"
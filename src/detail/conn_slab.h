@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "../jutil.h"
+
+namespace pnen::detail
+{
+using namespace jutil;
+
+//! @brief A reactor's live connections, addressed by generation-checked handles
+//!
+//! Event sources are handed a handle rather than the coroutine's address, so that an event that
+//! was queued for a connection which has since gone away (its slot possibly taken by a newer one)
+//! resolves to nothing instead of to freed memory or to someone else's frame. Slots are packed
+//! into one array and hold no pointers into it, so it can grow by reallocating; freed slots are
+//! reused most recent first, while still cache-warm.
+struct conn_slab {
+    using handle                   = uint64_t; // gen << 32 | index; 0 is never handed out
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    struct slot {
+        void *root;    // the connection's coroutine; null while free
+        uint32_t gen;  // bumped on release, which invalidates outstanding handles
+        uint32_t next; // next free slot, while free
+    };
+
+    std::vector<slot> slots;
+    uint32_t free = npos;
+
+    explicit conn_slab(const std::size_t n = 1024) { slots.reserve(n); }
+    NO_COPY_MOVE(conn_slab);
+
+    [[nodiscard]] JUTIL_INLINE handle insert(void *const root)
+    {
+        uint32_t i;
+        if (free != npos) {
+            i    = free;
+            free = slots[i].next;
+        } else {
+            i = static_cast<uint32_t>(slots.size());
+            slots.push_back({.root = nullptr, .gen = 1, .next = npos});
+        }
+        slots[i].root = root;
+        return uint64_t{slots[i].gen} << 32 | i;
+    }
+
+    JUTIL_INLINE void release(const handle h) noexcept
+    {
+        const auto i = static_cast<uint32_t>(h);
+        auto &s      = slots[i];
+        s.root       = nullptr;
+        s.gen        = s.gen + 1 ? s.gen + 1 : 1;
+        s.next       = free;
+        free         = i;
+    }
+
+    //! @return The coroutine h refers to, or null if its connection has gone away
+    [[nodiscard]] JUTIL_INLINE void *find(const handle h) const noexcept
+    {
+        const auto i = static_cast<uint32_t>(h);
+        if (i >= slots.size()) [[unlikely]]
+            return nullptr;
+        const auto &s = slots[i];
+        return s.gen == h >> 32 ? s.root : nullptr;
+    }
+};
+} // namespace pnen::detail
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#include "../jutil.h"
+
+//! @brief Synchronous generators, e.g. for producing a response body as it's being sent
+//!
+//! A generator<T> is a lazily started coroutine that co_yields values one at a time, each when
+//! next() is called. It doesn't belong to any connection, so it may be advanced on an offload
+//! worker when producing a value may block (e.g., reading a file); its frame comes from the
+//! general-purpose heap rather than the frame_pool for that reason.
+namespace pnen::detail
+{
+using namespace jutil;
+
+template <class T>
+struct [[nodiscard]] generator {
+    struct promise_type {
+        T value = {};
+        std::exception_ptr ex;
+
+        JUTIL_INLINE generator get_return_object() noexcept
+        {
+            return generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        constexpr JUTIL_INLINE std::suspend_always initial_suspend() const noexcept { return {}; }
+        constexpr JUTIL_INLINE std::suspend_always final_suspend() const noexcept { return {}; }
+        JUTIL_INLINE std::suspend_always yield_value(T x) noexcept(
+            std::is_nothrow_move_assignable_v<T>)
+        {
+            value = std::move(x);
+            return {};
+        }
+        constexpr JUTIL_INLINE void return_void() const noexcept {}
+        JUTIL_INLINE void unhandled_exception() noexcept { ex = std::current_exception(); }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    handle h;
+
+    generator() noexcept : h{} {}
+    explicit generator(const handle h_) noexcept : h{h_} {}
+    generator(generator &&o) noexcept : h{std::exchange(o.h, {})} {}
+    generator &operator=(generator &&o) noexcept
+    {
+        std::swap(h, o.h);
+        return *this;
+    }
+    ~generator()
+    {
+        if (h) h.destroy();
+    }
+
+    [[nodiscard]] explicit JUTIL_INLINE operator bool() const noexcept
+    {
+        return static_cast<bool>(h);
+    }
+
+    //! @brief Runs the coroutine up to its next co_yield
+    //! @return The value yielded, valid until the next call; null once the coroutine has finished
+    [[nodiscard]] JUTIL_INLINE T *next()
+    {
+        if (h.done()) return nullptr;
+        h.resume();
+        if (auto &p = h.promise(); p.ex) std::rethrow_exception(std::exchange(p.ex, {}));
+        return h.done() ? nullptr : &h.promise().value;
+    }
+
+    //! @brief Destroys the coroutine, if any, leaving the generator empty
+    JUTIL_INLINE void reset() noexcept
+    {
+        if (h) h.destroy(), h = {};
+    }
+};
+} // namespace pnen::detail
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <coroutine>
+#include <poll.h>
+#include <stdint.h>
+
+#include "../jutil.h"
+#include "offload.h"
+#include "server.h"
+#include "subtask.h"
+
+//! @brief Driving TLS handshakes on the handshake offload pool
+//!
+//! The private-key operations of a handshake happen within tls_handshake(); taken on the reactor,
+//! during an accept storm, every connection of the reactor waits behind them. handshake() instead
+//! waits for the socket on the reactor and takes each step on a worker of offload_pool::handshake,
+//! so that the connection comes back to its reactor established. Either way, it's established
+//! before anything's read of it, so that the protocol it negotiated (ALPN) is known by then.
+namespace pnen::detail
+{
+using namespace jutil;
+
+//! @brief Waits for the socket fd to become ready for given direction, without reading or writing
+struct readiness_awaitable {
+    int fd;
+    uint32_t want; // EPOLLIN or EPOLLOUT, which equal POLLIN and POLLOUT
+    io_wait w = {};
+
+    //! @note Checks first, as readiness may have been reported while a worker had the socket,
+    //!       which no one was waiting for then; without a socket (i.e., io_uring), there's nothing
+    //!       to check, and the reactor tells of what arrives
+    JUTIL_INLINE bool await_ready() const noexcept
+    {
+        pollfd pfd{.fd = fd, .events = static_cast<short>(want), .revents = 0};
+        return fd != -1 && poll(&pfd, 1, 0) == 1;
+    }
+    template <class P>
+    JUTIL_INLINE void await_suspend(const std::coroutine_handle<P> h) noexcept
+    {
+        auto &p = w(h);
+        p.rearm(want);
+        p.expect(deadline::idle);
+    }
+    constexpr JUTIL_INLINE void await_resume() const noexcept {}
+};
+
+//! @brief Completes the handshake of s, taking each step on the handshake pool
+//! @return Whether the handshake succeeded
+//! @note Without handshake workers, or with a transport not doing its own socket I/O (i.e.,
+//!       io_uring, where libtls goes through the reactor's buffers), each step is taken on the
+//!       reactor instead
+template <handshake_transport T>
+subtask<bool> handshake(socket<T> &s)
+{
+    if (s.t.fd == -1 || !offload_port::current(offload_pool::handshake)) {
+        for (;;) {
+            const auto ret = s.t.handshake();
+            if (ret == 0) co_return true;
+            if (ret != want_in && ret != want_out) co_return false;
+            co_await readiness_awaitable{s.t.fd, want_events(ret)};
+        }
+    }
+    for (uint32_t want = EPOLLIN;;) { // the client speaks first
+        co_await readiness_awaitable{s.t.fd, want};
+        const auto ret = co_await offload([&] { return s.t.handshake(); }, offload_pool::handshake);
+        if (ret == 0) co_return true;
+        if (ret != want_in && ret != want_out) co_return false;
+        want = want_events(ret);
+    }
+}
+} // namespace pnen::detail
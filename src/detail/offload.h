@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "../jutil.h"
+
+//! @brief Running blocking calls (e.g., file I/O) off the reactor threads
+//!
+//! co_await offload(f) hands f to a shared pool of worker threads and suspends the awaiting
+//! coroutine. Once f has returned, the worker posts the job to the offload_port of the reactor it
+//! came from, whose eventfd wakes that reactor up to resume the coroutine with f's result. The
+//! connection's deadline is paused meanwhile, so that a deadline can't destroy the coroutine from
+//! under f; if it's destroyed otherwise (e.g., it lost a when_any()), it waits for f to return.
+namespace pnen::detail
+{
+using namespace jutil;
+
+struct uring_conn;
+struct offload_port;
+
+//! @brief The worker pools there are to offload to; each has threads of its own, so that work of
+//!        one kind can't hold up the other
+enum class offload_pool : uint8_t {
+    blocking,  // blocking calls, e.g. file I/O
+    handshake, // TLS handshake steps (i.e., private-key operations)
+};
+inline constexpr std::size_t noffload_pools = 2;
+
+//! @brief Statistics of an offload_pool since it was started
+struct offload_stats {
+    uint64_t queued;  // jobs currently waiting for a worker
+    uint64_t jobs;    // jobs run
+    uint64_t wait_us; // time jobs have spent queued, in total
+    uint64_t run_us;  // time jobs have spent running, in total
+};
+
+struct offload_job {
+    enum state : uint8_t { queued, running, done, cancelled };
+
+    std::atomic<uint8_t> st   = queued;
+    offload_pool pool         = offload_pool::blocking;
+    offload_port *port        = {}; // null if run inline
+    std::coroutine_handle<> h = {}; // null once the awaiting coroutine has gone away
+    uring_conn *uc            = {}; // io_uring backend: the connection to settle after resuming
+    uint64_t posted           = 0;  // CLOCK_MONOTONIC ns
+    bool delivered            = false;
+
+    virtual ~offload_job() = default;
+    virtual void run() noexcept = 0;
+};
+
+//! @brief Where a reactor receives the offloaded jobs of its coroutines back
+struct offload_port {
+    int efd; // becomes readable once there are completed jobs
+    std::mutex mtx;
+    std::vector<offload_job *> done, batch;
+
+    offload_port();
+    NO_COPY_MOVE(offload_port);
+    ~offload_port();
+
+    //! @brief The port of the calling reactor thread; null if not on one or if given pool has no
+    //!        workers, in which case calls offloaded to it run inline
+    [[nodiscard]] static offload_port *current(offload_pool pool) noexcept;
+
+    //! @brief Called by a worker on finishing (or skipping) j
+    void complete(offload_job &j) noexcept;
+
+    //! @brief Calls f(offload_job &) on every completed job whose coroutine is still waiting;
+    //!        jobs whose coroutine has gone away are disposed of
+    template <class F>
+    void drain(F &&f) noexcept
+    {
+        uint64_t n;
+        [[maybe_unused]] const auto nr = read(efd, &n, sizeof(n));
+        {
+            std::scoped_lock lk{mtx};
+            std::swap(done, batch);
+        }
+        // f may destroy coroutines whose jobs are further on in the batch; those are then
+        // abandoned rather than deleted (see offload_release())
+        for (const auto j : batch) {
+            if (!j->h) {
+                delete j;
+            } else {
+                j->delivered = true;
+                f(*j);
+            }
+        }
+        batch.clear();
+    }
+};
+
+//! @brief Starts the worker threads of given pool; with none, calls offloaded to it run inline
+void offload_start(offload_pool pool, unsigned nthreads);
+
+//! @brief Queues j for the workers
+void offload_post(offload_job &j) noexcept;
+
+//! @brief Lets go of j on behalf of its awaitable, waiting for it to finish running if need be
+void offload_release(offload_job *j) noexcept;
+
+[[nodiscard]] offload_stats offload_totals(offload_pool pool) noexcept;
+
+template <class F>
+struct offload_awaitable {
+    using R = std::invoke_result_t<F &>;
+
+    struct job final : offload_job {
+        F f;
+        std::optional<std::conditional_t<std::is_void_v<R>, bool, R>> res;
+        std::exception_ptr ex;
+
+        explicit job(F &&f_) : f{std::move(f_)} {}
+        void run() noexcept override
+        {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    f();
+                    res.emplace(true);
+                } else {
+                    res.emplace(f());
+                }
+            } catch (...) {
+                ex = std::current_exception();
+            }
+        }
+    };
+
+    job *j;
+
+    offload_awaitable(F &&f, const offload_pool pool) : j{new job{std::move(f)}} { j->pool = pool; }
+    NO_COPY_MOVE(offload_awaitable);
+    ~offload_awaitable() { offload_release(j); }
+
+    JUTIL_INLINE bool await_ready() noexcept
+    {
+        if (offload_port::current(j->pool)) [[likely]]
+            return false;
+        j->run();
+        return true;
+    }
+    template <class P>
+    JUTIL_INLINE void await_suspend(const std::coroutine_handle<P> h) noexcept
+    {
+        auto &r = h.promise().root();
+        r.tw->cancel(r.timer); // resumes with the next wait for I/O (see promise_type::expect())
+        j->port = offload_port::current(j->pool);
+        j->h    = h;
+        j->uc   = r.uc;
+        offload_post(*j);
+    }
+    JUTIL_INLINE R await_resume()
+    {
+        if (j->ex) std::rethrow_exception(j->ex);
+        if constexpr (!std::is_void_v<R>) return std::move(*j->res);
+    }
+};
+
+//! @brief Runs f() on a worker thread of given pool, for the awaiting coroutine to resume with its
+//!        result
+//! @note f runs concurrently with the reactor, so whatever it touches mustn't be touched by others
+//!       until it has returned
+template <class F>
+[[nodiscard]] JUTIL_INLINE offload_awaitable<F>
+offload(F f, const offload_pool pool = offload_pool::blocking)
+{
+    return offload_awaitable<F>{std::move(f), pool};
+}
+} // namespace pnen::detail
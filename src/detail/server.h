@@ -8,26 +8,41 @@
 #include <boost/preprocessor/variadic/size.hpp>
 #include <concepts>
 #include <coroutine>
+#include <errno.h>
 #include <experimental/memory>
 #include <fcntl.h>
+#include <limits.h>
 #include <memory>
 #include <netinet/in.h>
 #include <numeric>
 #include <openssl/crypto.h>
 #include <openssl/ssl.h>
+#include <pthread.h>
 #include <ranges>
+#include <sched.h>
 #include <source_location>
 #include <span>
 #include <stdio.h>
+#include <string.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
-#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <thread>
 #include <tls.h>
 #include <unistd.h>
+#include <vector>
 
 #include "../jutil.h"
 #include "../vocabserv.h"
+#include "conn_slab.h"
+#include "offload.h"
+#include "tickets.h"
+#include "timer.h"
+#include "transport.h"
+#ifdef PNEN_IO_URING
+#include "uring.h"
+#endif
 
 #include "../lmacro_begin.h"
 
@@ -116,81 +131,371 @@ JUTIL_CI auto first_state(has_first_state auto &&x) noexcept(noexcept(x.first_st
     BOOST_PP_IF(BOOST_PP_CHECK_EMPTY(__VA_ARGS__), FOR_CO_AWAIT_dummy, FOR_CO_AWAIT_impl)          \
     (x, __VA_ARGS__)
 
+//! @brief How many bytes a connection may move through its socket before it yields to the others
+//!
+//! A connection whose peer keeps the socket ready (e.g., a fast client, or pipelined requests)
+//! never has to wait for it, so it would otherwise keep its reactor to itself until done. Once
+//! the budget has been used up, the socket's awaitables put the connection on the ready list and
+//! suspend; it's refilled then, and whenever the connection waits for its socket.
+struct io_budget {
+    std::size_t quantum = 0; // 0 = no limit
+    std::size_t left    = quantum;
+
+    //! @brief Accounts for n bytes moved
+    //! @return Whether the connection is to yield
+    JUTIL_INLINE bool charge(const std::size_t n) noexcept
+    {
+        if (!quantum) return false;
+        if (n < left) [[likely]]
+            return left -= n, false;
+        left = quantum;
+        return true;
+    }
+    JUTIL_INLINE void refill() noexcept { left = quantum; }
+};
+
+template <class T>
 struct read_state {
-    tls *tc;
+    T *t;
+    io_budget *budget;
     char *buf;
     char *bufspn;
     size_t nbufspn;
+    bool body; // reading a request body rather than a header
 };
 
+template <class T>
 struct write_state {
-    tls *tc;
+    T *t;
+    io_budget *budget;
     const char *buf;
     size_t nbuf;
+    bool more; // more is to follow; the transport may hold this back to send along with it
+
+    //! @brief Writes what the transport takes of the rest, advancing past it
+    JUTIL_INLINE ssize_t put() noexcept
+    {
+        ssize_t ret;
+        if constexpr (corking_transport<T>)
+            ret = more ? t->write_more(buf, nbuf) : t->write(buf, nbuf);
+        else
+            ret = t->write(buf, nbuf);
+        if (ret > 0) buf += ret, nbuf -= static_cast<size_t>(ret);
+        return ret;
+    }
+    [[nodiscard]] JUTIL_INLINE size_t remaining() const noexcept { return nbuf; }
+};
+
+template <class T>
+struct gather_state {
+    T *t;
+    io_budget *budget;
+    iovec *iov;  // segments yet to be written, the first possibly in part; advanced in place
+    size_t niov;
+    size_t n;    // bytes yet to be written
+    bool more;   // as for write_state
+
+    //! @brief Writes what the transport takes of the segments, in one call if it can gather them,
+    //!        otherwise of the first (holding it back, where the transport can, for the next)
+    JUTIL_INLINE ssize_t put() noexcept
+    {
+        if (!niov) [[unlikely]]
+            return 0;
+        ssize_t ret;
+        if constexpr (gather_transport<T>)
+            ret = t->writev(iov, static_cast<int>(std::min<size_t>(niov, IOV_MAX)), more);
+        else if constexpr (corking_transport<T>)
+            ret = more || niov > 1 ? t->write_more(iov->iov_base, iov->iov_len)
+                                   : t->write(iov->iov_base, iov->iov_len);
+        else
+            ret = t->write(iov->iov_base, iov->iov_len);
+        if (ret > 0) advance(static_cast<size_t>(ret));
+        return ret;
+    }
+    [[nodiscard]] JUTIL_INLINE size_t remaining() const noexcept { return n; }
+
+  private:
+    JUTIL_INLINE void advance(size_t k) noexcept
+    {
+        n -= k;
+        for (; niov && k >= iov->iov_len; ++iov, --niov)
+            k -= iov->iov_len;
+        if (k) iov->iov_base = static_cast<char *>(iov->iov_base) + k, iov->iov_len -= k;
+    }
+};
+
+template <class T>
+struct file_state {
+    T *t;
+    io_budget *budget;
+    int fd;
+    off_t off;
+    size_t n;
+
+    JUTIL_INLINE ssize_t put() noexcept
+    {
+        const auto ret = t->sendfile(fd, off, n);
+        if (ret > 0) n -= static_cast<size_t>(ret);
+        return ret == 0 && n ? -1 : ret; // the file has been truncated under us
+    }
+    [[nodiscard]] JUTIL_INLINE size_t remaining() const noexcept { return n; }
 };
 
 void log_ssl_error(tls *tc, const char *fname, int err,
                    std::source_location sl = std::source_location::current());
 
+struct uring_conn;
+
+//! @brief Allocator for coroutine frames: per-thread slabs of same-sized blocks
+//!
+//! Each thread (i.e., reactor) keeps a free list per frame size, refilled a slab at a time, so
+//! that frames are recycled while cache-warm and allocation never contends with other reactors.
+//! Memory is kept for reuse rather than returned to the system.
+struct frame_pool {
+    struct stats {
+        uint64_t hits;       // allocations served from a free list
+        uint64_t misses;     // allocations that had to carve a new slab
+        uint64_t live;       // frames currently allocated
+        uint64_t cached;     // frames on free lists
+        uint64_t live_bytes; // of the frames currently allocated
+        uint64_t slab_bytes; // of the slabs carved, which are kept for reuse
+    };
+
+    [[nodiscard]] static void *allocate(std::size_t n);
+    static void deallocate(void *p, std::size_t n) noexcept;
+
+    //! @brief Sums the statistics of every thread's pool
+    [[nodiscard]] static stats totals() noexcept;
+};
+
+//! @brief Connections that have yielded (see io_budget), to be resumed by their reactor once it has
+//!        seen to the events at hand
+//!
+//! Entries are intrusive, so that a connection going away (or being resumed otherwise) can take
+//! itself off in O(1).
+struct ready_list {
+    struct node {
+        node *prev = nullptr, *next = nullptr;
+        void *ud   = nullptr; // the root coroutine's address
+        [[nodiscard]] JUTIL_INLINE bool linked() const noexcept { return next; }
+    };
+
+    node head;
+
+    ready_list() noexcept { head.prev = head.next = &head; }
+    NO_COPY_MOVE(ready_list);
+
+    [[nodiscard]] JUTIL_INLINE bool empty() const noexcept { return head.next == &head; }
+
+    JUTIL_INLINE void push(node &n) noexcept
+    {
+        if (n.linked()) return;
+        n.prev          = head.prev;
+        n.next          = &head;
+        head.prev->next = &n;
+        head.prev       = &n;
+    }
+
+    static JUTIL_INLINE void remove(node &n) noexcept
+    {
+        if (!n.linked()) return;
+        n.prev->next = n.next;
+        n.next->prev = n.prev;
+        n.prev = n.next = nullptr;
+    }
+
+    //! @brief Calls f(void *ud) on every entry there is as of calling, taking each off first;
+    //!        entries pushed meanwhile are left for the next call
+    template <class F>
+    void run(F &&f)
+    {
+        if (empty()) return;
+        node batch;
+        batch.next       = head.next;
+        batch.prev       = head.prev;
+        batch.next->prev = batch.prev->next = &batch;
+        head.prev = head.next = &head;
+        while (batch.next != &batch) {
+            auto &n = *batch.next;
+            remove(n);
+            f(n.ud);
+        }
+    }
+};
+
 struct task {
     JUTIL_PUSH_DIAG(JUTIL_WNO_SUBOBJ_LINKAGE)
     struct promise_type {
-        tls *tc;
-        int sfd, tfd;
+        int sfd, epfd;       // -1 with the io_uring backend
+        uint32_t events;     // interest the socket is currently registered with (edge-triggered)
+        uring_conn *uc = {}; // io_uring backend: owner of the socket
+        timer_wheel *tw;
+        timer_node timer;
+        ready_list *rq = {}; // where the connection goes on yielding
+        ready_list::node ready;
+        conn_slab *slab      = {}; // epoll backend: where the socket's events are resolved
+        conn_slab::handle id = {}; // what they refer to the connection by
+        // the coroutine waiting on the socket, be it this one or a subtask; resumed by the reactor
+        std::coroutine_handle<> cur                   = std::noop_coroutine();
         promise_type()                                = default;
         promise_type(const promise_type &)            = delete;
         promise_type(promise_type &&)                 = delete;
         promise_type &operator=(const promise_type &) = delete;
         promise_type &operator=(promise_type &&)      = delete;
+        // the connection itself is closed by its transport, which lives on as a parameter copy
+        // of the coroutine for a little longer
         ~promise_type()
         {
-            CHECK(tls_close(tc), != -1);
-            CHECK(close(sfd), != -1);
-            CHECK(close(tfd), != -1);
-            tls_free(tc);
+            tw->cancel(timer);
+            ready_list::remove(ready);
+            if (slab) slab->release(id);
+#ifdef PNEN_IO_URING
+            if (uc) uc->detach();
+#endif
+        }
+        [[nodiscard]] static JUTIL_INLINE void *operator new(const std::size_t n)
+        {
+            return frame_pool::allocate(n);
+        }
+        static JUTIL_INLINE void operator delete(void *const p, const std::size_t n) noexcept
+        {
+            frame_pool::deallocate(p, n);
         }
         constexpr JUTIL_INLINE task get_return_object() & { return {*this}; }
         constexpr JUTIL_INLINE std::suspend_always initial_suspend() { return {}; }
         constexpr JUTIL_INLINE std::suspend_never final_suspend() noexcept { return {}; }
         constexpr JUTIL_INLINE void return_void() {}
         constexpr JUTIL_INLINE void unhandled_exception() {}
+        [[nodiscard]] constexpr JUTIL_INLINE promise_type &root() noexcept { return *this; }
+
+        //! @brief Resumes whatever coroutine of the connection with given root waits on its socket
+        static JUTIL_INLINE void wake(void *const root) noexcept
+        {
+            std::coroutine_handle<promise_type>::from_address(root).promise().cur.resume();
+        }
+
+        //! @brief Has the reactor resume the connection once it has seen to its other events
+        JUTIL_INLINE void yield() noexcept
+        {
+            ready.ud = std::coroutine_handle<promise_type>::from_promise(*this).address();
+            rq->push(ready);
+        }
+
+        //! @brief Makes the socket report readiness for given direction only
+        //! @param ev EPOLLIN or EPOLLOUT, as asked for by the transport
+        JUTIL_INLINE void rearm(const uint32_t ev) noexcept
+        {
+            if (ev == events) [[likely]]
+                return;
+            events = ev;
+            if (epfd == -1) return; // io_uring: the reactor resumes by looking at events
+            epoll_event e{.events = ev | EPOLLET, .data{.u64 = id}};
+            CHECK(epoll_ctl(epfd, EPOLL_CTL_MOD, sfd, &e), != -1);
+        }
+
+        //! @brief Arms the connection's timer for what it's about to wait for
+        //! @param restart Whether to restart an idle or header deadline that's already running
+        //! @note Idle and header deadlines keep running while the kind stays the same, whereas
+        //!       write and body deadlines restart on every wait (i.e., after every bit of progress)
+        JUTIL_INLINE void expect(const deadline d, const bool restart = false) noexcept
+        {
+            if (!restart && d != deadline::write && d != deadline::body && timer.armed() &&
+                timer.kind == d) [[likely]]
+                return;
+            tw->arm(timer, d);
+        }
     };
     JUTIL_POP_DIAG()
     promise_type &p;
 };
 
+//! @brief Makes the awaiting coroutine the one its connection's socket readiness (or its turn on
+//!        the ready list) resumes, for as long as the awaitable this is a member of lives
+struct io_wait {
+    task::promise_type *root  = {};
+    std::coroutine_handle<> h = {};
+    io_wait()                 = default;
+    NO_COPY_MOVE(io_wait);
+    ~io_wait()
+    {
+        if (!root) return;
+        if (root->cur == h) root->cur = std::noop_coroutine();
+        ready_list::remove(root->ready); // in case of having yielded, but woken up by readiness
+    }
+    template <class P>
+    JUTIL_INLINE task::promise_type &operator()(const std::coroutine_handle<P> h_) noexcept
+    {
+        root = &h_.promise().root();
+        h = root->cur = h_;
+        return *root;
+    }
+};
+
+//! @brief Maps a want_{in,out} into the epoll interest it stands for
+JUTIL_CI uint32_t want_events(const ssize_t ret) noexcept
+{
+    return ret == want_in ? EPOLLIN : EPOLLOUT;
+}
+
+//! @brief A connection as seen by its coroutine
+//! @tparam T The transport, fixed at compile time so that e.g. plaintext has no TLS in its path
+template <transport T>
 struct socket {
-    tls *tc;
+    T t;
+    io_budget budget = {};
 
     //
     // read
     //
 
   private:
+    // The I/O is attempted in await_ready() so that the coroutine only suspends when the transport
+    // can't make progress; the direction it's waiting on is then armed in await_suspend().
+    template <bool F>
     struct read_state_awaitable {
-        read_state &rs;
-        JUTIL_INLINE bool await_ready() noexcept { return false; }
-        JUTIL_INLINE void await_suspend(std::coroutine_handle<>) noexcept {}
-        JUTIL_INLINE loop_state await_resume() noexcept
+        read_state<T> &rs;
+        loop_state st = loop_state::suspend;
+        uint32_t want = EPOLLIN; // 0 = yielding rather than waiting for the socket
+        io_wait w     = {};
+        JUTIL_INLINE bool await_ready() noexcept
         {
             // TODO: investigate broken pipe: g_log.debug() every socket-related action
-            const auto ret = tls_read(rs.tc, rs.bufspn, rs.nbufspn);
-            if (ret == TLS_WANT_POLLIN || ret == TLS_WANT_POLLOUT) {
-                return loop_state::suspend;
-            } else if (ret == -1) {
-                return loop_state::error;
+            const auto ret = rs.t->read(rs.bufspn, rs.nbufspn);
+            if (ret == want_in || ret == want_out) {
+                want = want_events(ret);
+                return false;
+            } else if (ret <= 0) { // error or EOF
+                st = loop_state::error;
             } else [[likely]] {
                 rs.bufspn += ret;
                 rs.nbufspn -= ret;
-                return loop_state::has_next;
+                st = loop_state::has_next;
+                if (rs.budget->charge(static_cast<size_t>(ret))) [[unlikely]]
+                    return want = 0, false;
             }
+            return true;
+        }
+        template <class P>
+        JUTIL_INLINE void await_suspend(const std::coroutine_handle<P> h) noexcept
+        {
+            auto &p = w(h);
+            if (!want) return p.yield();
+            rs.budget->refill();
+            p.rearm(want);
+            // a fresh read with nothing buffered waits for another request; responses written
+            // without waiting would otherwise leave the previous request's idle deadline running
+            const auto idle = !rs.body && rs.bufspn == rs.buf;
+            const auto d    = rs.body ? deadline::body : idle ? deadline::idle : deadline::header;
+            p.expect(d, F && idle);
         }
+        JUTIL_INLINE loop_state await_resume() const noexcept { return st; }
     };
-    struct read_res : read_state {
-        JUTIL_INLINE read_state_awaitable state() noexcept { return {*this}; }
-        JUTIL_INLINE std::tuple<std::span<char>, read_state &> next() noexcept
+    struct read_res : read_state<T> {
+        JUTIL_INLINE read_state_awaitable<true> first_state() noexcept { return {*this}; }
+        JUTIL_INLINE read_state_awaitable<false> state() noexcept { return {*this}; }
+        JUTIL_INLINE std::tuple<std::span<char>, read_state<T> &> next() noexcept
         {
-            return {{buf, bufspn}, {*this}};
+            return {{this->buf, this->bufspn}, {*this}};
         }
     };
 
@@ -198,10 +503,37 @@ struct socket {
     //! @brief Read indefinitely from socket
     //! @param buf The start of destination buffer
     //! @param nbuf The maximum amount of bytes to read
+    //! @param nread The amount of bytes already in buf (e.g., a pipelined request)
     //! @return read_res_iter Await-iterable yielding amount of bytes read
-    [[nodiscard]] JUTIL_INLINE read_res read(char *const buf, const size_t nbuf) const noexcept
+    [[nodiscard]] JUTIL_INLINE read_res read(char *const buf, const size_t nbuf,
+                                             const size_t nread = 0) noexcept
     {
-        return {{.tc = tc, .buf = buf, .bufspn = buf, .nbufspn = nbuf}};
+        return {{.t       = &t,
+                 .budget  = &budget,
+                 .buf     = buf,
+                 .bufspn  = buf + nread,
+                 .nbufspn = nbuf - nread,
+                 .body    = false}};
+    }
+
+    //! @brief Read a request body from socket; as read(), but waiting under deadline::body
+    [[nodiscard]] JUTIL_INLINE read_res read_body(char *const buf, const size_t nbuf,
+                                                  const size_t nread = 0) noexcept
+    {
+        return {{.t       = &t,
+                 .budget  = &budget,
+                 .buf     = buf,
+                 .bufspn  = buf + nread,
+                 .nbufspn = nbuf - nread,
+                 .body    = true}};
+    }
+
+    //! @brief Reads what's already arrived without waiting for more, e.g. to take in what the peer
+    //!        of a multiplexed connection sent while responses were being written
+    //! @return As the transport's read(): want_in (or want_out) if nothing has arrived
+    [[nodiscard]] JUTIL_INLINE ssize_t try_read(char *const buf, const size_t nbuf) noexcept
+    {
+        return t.read(buf, nbuf);
     }
 
     //
@@ -209,48 +541,124 @@ struct socket {
     //
 
   private:
-    template <bool F>
+    template <class S, bool F>
     struct write_state_awaitable {
-        write_state &ws;
-        JUTIL_INLINE bool await_ready() noexcept { return false; }
-        JUTIL_INLINE void await_suspend(std::coroutine_handle<>) noexcept {}
-        JUTIL_INLINE loop_state await_resume() noexcept
+        S &ws;
+        loop_state st = loop_state::suspend;
+        uint32_t want = EPOLLOUT; // 0 = yielding rather than waiting for the socket
+        io_wait w     = {};
+        JUTIL_INLINE bool await_ready() noexcept
         {
-            // if constexpr (F) return loop_state::exhausted;
-            const auto ret = tls_write(ws.tc, ws.buf, ws.nbuf);
-            if (ret == TLS_WANT_POLLIN || ret == TLS_WANT_POLLOUT) {
-                return loop_state::suspend;
+            const auto ret = ws.put();
+            if (ret == want_in || ret == want_out) {
+                want = want_events(ret);
+                return false;
             } else if (ret == -1) {
-                return loop_state::error;
+                st = loop_state::error;
             } else [[likely]] {
-                ws.buf += ret;
-                ws.nbuf -= ret;
-                return (ws.nbuf > 0) ? loop_state::suspend : loop_state::exhausted;
+                st = ws.remaining() ? loop_state::suspend : loop_state::exhausted;
+                if (ws.budget->charge(static_cast<size_t>(ret))) [[unlikely]]
+                    return want = 0, false;
             }
+            return true;
         }
+        template <class P>
+        JUTIL_INLINE void await_suspend(const std::coroutine_handle<P> h) noexcept
+        {
+            auto &p = w(h);
+            if (!want) return p.yield();
+            ws.budget->refill();
+            p.rearm(want);
+            p.expect(deadline::write);
+        }
+        JUTIL_INLINE loop_state await_resume() const noexcept { return st; }
     };
-    struct write_res : write_state {
-        JUTIL_INLINE write_state_awaitable<true> first_state() noexcept { return {*this}; }
-        JUTIL_INLINE write_state_awaitable<false> state() noexcept { return {*this}; }
+    template <class S>
+    struct write_res_of : S {
+        JUTIL_INLINE write_state_awaitable<S, true> first_state() noexcept { return {*this}; }
+        JUTIL_INLINE write_state_awaitable<S, false> state() noexcept { return {*this}; }
     };
+    using write_res    = write_res_of<write_state<T>>;
+    using gather_res   = write_res_of<gather_state<T>>;
+    using sendfile_res = write_res_of<file_state<T>>;
 
   public:
-    JUTIL_INLINE write_res write(const char *const buf, size_t nbuf) const noexcept
+    //! @param more Whether more is to be written right after, so that small writes can go out
+    //!             together (see corking_transport); the last write of a response is not to be one
+    JUTIL_INLINE write_res write(const char *const buf, size_t nbuf,
+                                 const bool more = false) noexcept
+    {
+        return {{.t = &t, .budget = &budget, .buf = buf, .nbuf = nbuf, .more = more}};
+    }
+    [[nodiscard]] JUTIL_INLINE write_res write(const std::string_view buf,
+                                               const bool more = false) noexcept
     {
-        return {{.tc = tc, .buf = buf, .nbuf = nbuf}};
+        return write(buf.data(), buf.size(), more);
     }
-    [[nodiscard]] JUTIL_INLINE write_res write(const std::string_view buf) const noexcept
+
+    //! @brief Writes segs in order without concatenating them; they're advanced past what's sent
+    //! @param more As for write()
+    [[nodiscard]] JUTIL_INLINE gather_res write(const std::span<iovec> segs,
+                                                const bool more = false) noexcept
+    {
+        size_t n = 0;
+        for (const auto &v : segs)
+            n += v.iov_len;
+        return {{.t      = &t,
+                 .budget = &budget,
+                 .iov    = segs.data(),
+                 .niov   = segs.size(),
+                 .n      = n,
+                 .more   = more}};
+    }
+
+    //! @brief Sends n bytes of file fd from off on, straight from the page cache
+    [[nodiscard]] JUTIL_INLINE sendfile_res sendfile(const int fd, const off_t off,
+                                                     const size_t n) noexcept
+        requires file_transport<T>
     {
-        return write(buf.data(), buf.size());
+        return {{.t = &t, .budget = &budget, .fd = fd, .off = off, .n = n}};
     }
 };
 
+enum class io_backend { epoll, io_uring };
+
 struct run_server_options {
-    uint16_t hostport    = 3000;
-    timespec timeout     = {.tv_sec = 5};
-    const char *ssl_cert = nullptr;
-    const char *ssl_pkey = nullptr;
-    const char *pk_pass  = {};
+    uint16_t hostport          = 3000;
+    timespec timeout           = {.tv_sec = 5};  // idle: handshake and waiting for a request
+    timespec header_timeout    = {.tv_sec = 10}; // from a request's first byte to its CRLFCRLF
+    timespec write_timeout     = {.tv_sec = 10}; // without the peer taking any response bytes
+    timespec body_timeout      = {.tv_sec = 10}; // without the peer sending any request body bytes
+    const char *ssl_cert       = nullptr; // without one, connections are plaintext
+    const char *ssl_pkey       = nullptr;
+    const char *pk_pass        = {};
+    uint32_t session_lifetime  = 2 * 60 * 60; // s TLS sessions can be resumed for; 0 = never
+    const char *ticket_keys    = nullptr; // file to share session ticket keys through with others
+    const char *alpn           = nullptr; // protocols offered through ALPN, e.g. "h2,http/1.1"
+    unsigned nreactors         = 1;     // reactor threads; 0 = one per available CPU
+    bool pin_cpus              = false; // pin reactor #i to the i-th available CPU
+    io_backend backend         = io_backend::epoll; // io_uring requires building with PNEN_IO_URING
+    int backlog                = SOMAXCONN; // listen() backlog of each reactor's socket
+    unsigned accept_budget     = 64;        // accepts per listener wakeup; 0 = until EAGAIN
+    unsigned offload_threads   = 4; // workers for blocking calls (see offload()); 0 = run inline
+    unsigned handshake_threads = 0; // workers for TLS handshakes (see handshake()); 0 = reactors
+    unsigned resume_budget     = 256 * 1024; // bytes per turn (see io_budget); 0 = no limit
+};
+
+//! @brief The timeouts of o in ms, indexed by deadline
+JUTIL_CI std::array<uint32_t, 4> deadline_ms(const run_server_options &o) noexcept
+{
+    constexpr auto ms = [](const timespec &ts) {
+        return static_cast<uint32_t>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+    };
+    return {ms(o.timeout), ms(o.header_timeout), ms(o.write_timeout), ms(o.body_timeout)};
+}
+
+//! @brief A coroutine suspended in sleep_for(); what the ud of a deadline::wake timer points to
+struct sleeper {
+    timer_node node;
+    std::coroutine_handle<> h = {};
+    task::promise_type *root  = {};
 };
 
 template <class F, class... Args>
@@ -260,70 +668,304 @@ using crhdlty = typename std::coroutine_handle<typename promisety<F, Args...>::p
 
 enum class severity { info, error };
 
-template <callable_r<task, socket &&> Task>
-JUTIL_INLINE void run_server(const run_server_options o, Task on_accept)
+//! @brief Pins the calling thread to the i-th CPU of the process' affinity mask (modulo its size)
+//! @return Whether the affinity could be set
+bool pin_to_cpu(unsigned i) noexcept;
+
+//! @brief Wraps accepted connections into plaintext transports
+struct tcp_acceptor {
+    JUTIL_INLINE tcp_transport operator()(const int fd) const noexcept { return tcp_transport{fd}; }
+    constexpr JUTIL_INLINE void maintain(uint64_t) const noexcept {}
+#ifdef PNEN_IO_URING
+    JUTIL_INLINE uring_transport operator()(uring_conn &uc) const noexcept { return {&uc}; }
+#endif
+};
+
+//! @brief Wraps accepted connections into TLS transports of given server context
+struct tls_acceptor {
+    tls *ts;
+    ticket_sync *tk; // null without session resumption
+
+    //! @brief Called by the event loop on every iteration, with its current tick
+    JUTIL_INLINE void maintain(const uint64_t now) const noexcept
+    {
+        if (tk) tk->maintain(now);
+    }
+    tls_transport operator()(const int fd) const noexcept
+    {
+        tls *tc;
+        CHECK(tls_accept_socket(ts, &tc, fd), != -1);
+        return {tc, fd};
+    }
+#ifdef PNEN_IO_URING
+    tls_transport operator()(uring_conn &uc) const noexcept
+    {
+        tls *tc;
+        CHECK(tls_accept_cbs(ts, &tc, uring_conn::read_cb, uring_conn::write_cb, &uc), != -1);
+        return {tc, -1};
+    }
+#endif
+};
+
+// clang-format off
+template <class Task, class... Ts>
+concept handles_all = (callable_r<Task, task, socket<Ts> &&> && ...);
+//! @brief Task can be started on a connection of any transport run_server() may pick
+template <class Task>
+concept connection_handler =
+#ifdef PNEN_IO_URING
+    handles_all<Task, tcp_transport, tls_transport, uring_transport>;
+#else
+    handles_all<Task, tcp_transport, tls_transport>;
+#endif
+// clang-format on
+
+//! @brief The epoll event loop: readiness-based, transports do their own socket I/O
+template <class Acceptor, callable_r<task, socket<call_result<const Acceptor &, int>> &&> Task>
+void run_epoll_loop(const run_server_options &o, Task &on_accept, const int acfd,
+                    const Acceptor &acc)
+{
+    using sock      = socket<call_result<const Acceptor &, int>>;
+    using crhdl     = crhdlty<Task, sock &&>;
+
+    const auto epfd = CHECK(epoll_create1(0), != -1);
+    epoll_event e{.events = EPOLLIN}, es[16];
+    timer_wheel tw{deadline_ms(o)};
+    ready_list rq;
+    conn_slab conns;
+    offload_port port;
+    constexpr auto port_key = ~conn_slab::handle{}; // 0 is the listener's
+    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, acfd, &e), != -1);
+    e = {.events = EPOLLIN, .data{.u64 = port_key}};
+    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, port.efd, &e), != -1);
+    for (;;) {
+        const auto tmo = rq.empty() ? tw.timeout() : 0; // yielded connections are not to wait
+        int i          = call_while(L0(epoll_wait(epfd, es, 16, tmo), &), L(PNEN_dbg(x == -1, 0)));
+        tw.update();
+        acc.maintain(tw.clock);
+        while (i--) {
+            if (!es[i].data.u64) {
+                // drain the backlog, up to the budget; the listener is level-triggered, so whatever
+                // is left over gets reported again by the next epoll_wait()
+                for (unsigned n = 0; !o.accept_budget || n < o.accept_budget; ++n) {
+                    const auto fd = accept4(acfd, nullptr, nullptr, SOCK_NONBLOCK);
+                    if (fd == -1) {
+                        if (errno == ECONNABORTED || errno == EINTR) continue;
+                        if (errno != EAGAIN) g_log.error("accept4() failed: ", strerror(errno));
+                        break;
+                    }
+
+                    auto &p  = on_accept(sock{acc(fd), {o.resume_budget}}).p;
+                    p.sfd    = fd;
+                    p.epfd   = epfd;
+                    p.events = EPOLLIN; // the client speaks first (ClientHello or request)
+                    p.tw     = &tw;
+                    p.rq     = &rq;
+                    auto h   = crhdl::from_promise(p);
+                    p.slab   = &conns;
+                    p.id     = conns.insert(h.address());
+                    e        = {.events = EPOLLIN | EPOLLET, .data{.u64 = p.id}};
+                    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &e), != -1);
+
+                    p.timer.ud = h.address();
+                    tw.arm(p.timer, deadline::idle);
+                    h.resume();
+                }
+            } else if (es[i].data.u64 == port_key) [[unlikely]] {
+                port.drain(L(x.h.resume()));
+            } else if (const auto root = conns.find(es[i].data.u64)) [[likely]] {
+                task::promise_type::wake(root);
+            } // else it has gone away since the event was queued
+        }
+        rq.run(L(task::promise_type::wake(x)));
+        // only after the events: a destroyed coroutine may not be among es[] anymore
+        tw.expire([](const timer_node &t) {
+            if (t.kind == deadline::wake) return static_cast<sleeper *>(t.ud)->h.resume();
+            crhdl::from_address(t.ud).destroy();
+        });
+    }
+}
+
+#ifdef PNEN_IO_URING
+//! @brief The io_uring event loop: completion-based, transports do their I/O through uring_conn
+template <class Acceptor,
+          callable_r<task, socket<call_result<const Acceptor &, uring_conn &>> &&> Task>
+void run_uring_loop(const run_server_options &o, Task &on_accept, const int acfd,
+                    const Acceptor &acc)
+{
+    using sock  = socket<call_result<const Acceptor &, uring_conn &>>;
+    using crhdl = crhdlty<Task, sock &&>;
+
+    uring_reactor r;
+    if (!r.init()) return;
+    timer_wheel tw{deadline_ms(o)};
+    ready_list rq;
+    offload_port port;
+    r.arm_accept(acfd);
+    r.arm_notify(port.efd);
+    io_uring_cqe *cqes[64];
+    for (;;) {
+        r.flush();
+        const auto tmo = rq.empty() ? tw.timeout() : 0;
+        __kernel_timespec kts{.tv_sec = tmo / 1000, .tv_nsec = tmo % 1000 * 1000000};
+        if (const auto err = io_uring_submit_and_wait_timeout(&r.ring, cqes, 1,
+                                                               tmo == -1 ? nullptr : &kts, nullptr);
+            err < 0 && err != -EINTR && err != -ETIME) {
+            g_log.error("io_uring_submit_and_wait_timeout() failed: ", strerror(-err));
+            return;
+        }
+        tw.update();
+        acc.maintain(tw.clock);
+        const auto n = io_uring_peek_batch_cqe(&r.ring, cqes, 64);
+        for (unsigned i = 0; i < n; ++i) {
+            const auto &cqe = *cqes[i];
+            const auto [c, op] = uring_reactor::untag(io_uring_cqe_get_data64(&cqe));
+            if (op == uring_op::accept) {
+                if (!(cqe.flags & IORING_CQE_F_MORE)) r.arm_accept(acfd);
+                if (cqe.res < 0) continue;
+
+                auto &uc   = *new uring_conn{r, cqe.res};
+                auto &p    = on_accept(sock{acc(uc), {o.resume_budget}}).p;
+                p.sfd      = p.epfd = -1;
+                p.events   = EPOLLIN;
+                p.uc       = &uc;
+                p.tw       = &tw;
+                p.rq       = &rq;
+                uc.h       = crhdl::from_promise(p);
+                uc.want    = &p.events;
+                p.timer.ud = uc.h.address();
+                tw.arm(p.timer, deadline::idle);
+                uc.h.resume();
+                r.settle(uc);
+            } else if (op == uring_op::notify) [[unlikely]] {
+                r.arm_notify(port.efd);
+                port.drain([&](const offload_job &j) {
+                    auto &uc = *j.uc;
+                    j.h.resume();
+                    r.settle(uc);
+                });
+            } else if (op != uring_op::ignore) [[likely]] {
+                if (r.complete(*c, op, cqe)) task::promise_type::wake(c->h.address());
+                r.settle(*c);
+            }
+        }
+        io_uring_cq_advance(&r.ring, n);
+        rq.run([&](void *const root) {
+            auto &uc = *std::coroutine_handle<task::promise_type>::from_address(root).promise().uc;
+            task::promise_type::wake(root);
+            r.settle(uc);
+        });
+        tw.expire([&](const timer_node &t) {
+            if (t.kind == deadline::wake) {
+                const auto &s = *static_cast<sleeper *>(t.ud);
+                auto &uc      = *s.root->uc;
+                s.h.resume();
+                return void(r.settle(uc));
+            }
+            const auto h = crhdl::from_address(t.ud);
+            auto &uc     = *h.promise().uc;
+            h.destroy();
+            r.settle(uc);
+        });
+    }
+}
+#endif
+
+//! @brief Runs the event loop of the configured backend with given kind of transport
+template <class Task, class Acceptor>
+void run_loop(const run_server_options &o, Task &on_accept, const int acfd, const Acceptor &acc)
 {
-    using crhdl     = crhdlty<Task, socket &&>;
+    if (o.backend == io_backend::io_uring) {
+#ifdef PNEN_IO_URING
+        return run_uring_loop(o, on_accept, acfd, acc);
+#else
+        g_log.warn("built without PNEN_IO_URING, falling back to epoll");
+#endif
+    }
+    run_epoll_loop(o, on_accept, acfd, acc);
+}
 
-    const auto acfd = CHECK(::socket(AF_INET, SOCK_STREAM, 0), != -1);
+//! @brief Runs a single event loop; reactors share nothing but the port (via SO_REUSEPORT)
+//! @param key The private key shared among all reactors; empty if serving plaintext
+template <connection_handler Task>
+void run_reactor(const run_server_options &o, Task on_accept, const std::span<uint8_t> key)
+{
+    const auto acfd = CHECK(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0), != -1);
     const int flag  = 1;
     CHECK(setsockopt(acfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag)), != -1);
+    CHECK(setsockopt(acfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)), != -1);
     sockaddr_in sin{.sin_family = AF_INET, .sin_port = htons(o.hostport), .sin_addr{INADDR_ANY}};
     CHECK(bind(acfd, reinterpret_cast<const sockaddr *>(&sin), sizeof(sin)), != -1);
-    CHECK(listen(acfd, 5), != -1);
+    CHECK(listen(acfd, o.backlog), != -1);
 
-    const auto tcnf = tls_config_new();
-    if (!tcnf) return g_log.error("tls_config_new() failed");
-    DEFER[=] { tls_config_free(tcnf); };
-
-    tls_config_set_cert_file(tcnf, o.ssl_cert);
-    size_t nkey;
-    const auto keyf = tls_load_file(o.ssl_pkey, &nkey, const_cast<char *>(o.pk_pass));
-    if (!keyf) return g_log.error("tls_load_file() failed");
-    DEFER[=] { tls_unload_file(keyf, nkey); };
-    CHECK(tls_config_set_key_mem(tcnf, keyf, nkey), != -1);
+    if (!o.ssl_cert) return run_loop(o, on_accept, acfd, tcp_acceptor{});
 
     const auto ts = tls_server();
     if (!ts) return g_log.error("tls_server() failed");
     DEFER[=] { tls_free(ts); };
-    CHECK(tls_configure(ts, tcnf), != -1);
+    ticket_sync tk{ts, &o, key};
+    if (!tk.configure()) return;
 
-    const auto epfd = CHECK(epoll_create1(0), != -1);
-    epoll_event e{.events = EPOLLIN | EPOLLOUT}, es[16];
-    const itimerspec its{.it_value = o.timeout};
-    CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, acfd, &e), != -1);
-    for (;;) {
-        int i = call_while(L0(epoll_wait(epfd, es, 16, -1), &), L(PNEN_dbg(x == -1, 0))) - 1;
-        do {
-            if (!es[i].data.ptr) {
-                socklen_t nsin = sizeof(sin);
-                const auto fd  = CHECK(
-                     accept4(acfd, reinterpret_cast<sockaddr *>(&sin), &nsin, SOCK_NONBLOCK), != -1);
-
-                tls *tc;
-                CHECK(tls_accept_socket(ts, &tc, fd), != -1);
-
-                auto &p    = on_accept(socket{tc}).p;
-                p.tc       = tc;
-                p.sfd      = fd;
-                auto h     = crhdl::from_promise(p);
-                e.data.ptr = h.address();
-                CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &e), != -1);
-
-                p.tfd = CHECK(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), -1);
-                CHECK(timerfd_settime(p.tfd, 0, &its, nullptr), -1);
-                e.data.ptr = to_ptr(to_uint(e.data.ptr) ^ 1);
-                CHECK(reinterpret_cast<uintptr_t>(e.data.ptr) & 1);
-                CHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, p.tfd, &e) != -1);
-
-                h.resume();
-            } else if (const auto iptr = to_uint(es[i].data.ptr); iptr & 1) {
-                crhdl::from_address(reinterpret_cast<void *>(iptr ^ 1)).destroy();
-            } else [[likely]] {
-                crhdl::from_address(es[i].data.ptr).resume();
-            }
-        } while (i--);
+    run_loop(o, on_accept, acfd, tls_acceptor{ts, o.session_lifetime ? &tk : nullptr});
+}
+
+//! @brief Runs o.nreactors event loops, the calling thread serving as the first one
+//! @note Connections are TLS if o.ssl_cert is given, plaintext otherwise
+template <connection_handler Task>
+JUTIL_INLINE void run_server(const run_server_options o, Task on_accept)
+{
+    size_t nkey   = 0;
+    uint8_t *keyf = nullptr;
+    if (o.ssl_cert) {
+        keyf = tls_load_file(o.ssl_pkey, &nkey, const_cast<char *>(o.pk_pass));
+        if (!keyf) return g_log.error("tls_load_file() failed");
+    }
+    DEFER[=] {
+        if (keyf) tls_unload_file(keyf, nkey);
+    };
+    const std::span key{keyf, nkey};
+
+    offload_start(offload_pool::blocking, o.offload_threads);
+    if (o.ssl_cert) {
+        offload_start(offload_pool::handshake, o.handshake_threads);
+        if (o.session_lifetime) tickets_start(o.session_lifetime, o.ticket_keys);
     }
+    const auto nr = o.nreactors ? o.nreactors : std::max(std::thread::hardware_concurrency(), 1u);
+    const auto reactor = [&](const unsigned i) {
+        if (o.pin_cpus && !pin_to_cpu(i)) g_log.warn("couldn't pin reactor #", i, " to a CPU");
+        run_reactor(o, on_accept, key);
+    };
+    std::vector<std::jthread> ts;
+    ts.reserve(nr - 1);
+    for (unsigned i = 1; i < nr; ++i)
+        ts.emplace_back(reactor, i);
+    reactor(0u);
+}
+
+//! @brief Starts on_accept on an in-memory connection, e.g. to exercise a handler without sockets
+//! @param in What the client sends
+//! @param out What the server responds with
+//! @param tw The timer wheel the connection's deadlines go to; the caller runs it
+//! @param a The rest of the arguments of M's constructor, e.g. the protocol mem_alpn_transport
+//!          negotiates
+//! @return The coroutine, to be woken (see promise_type::wake()) by the caller whenever what it
+//!         waits for (see promise_type::events) may have become available; once done, it destroys
+//!         itself and out.closed gets set
+template <std::derived_from<mem_transport> M = mem_transport, class Task, class... A>
+    requires callable_r<Task, task, socket<M> &&>
+auto connect_mem(Task &on_accept, mem_pipe &in, mem_pipe &out, timer_wheel &tw, A &&...a)
+{
+    using crhdl    = crhdlty<Task, socket<M> &&>;
+
+    auto &p        = on_accept(socket<M>{M{in, out, std::forward<A>(a)...}}).p;
+    p.sfd = p.epfd = -1;
+    p.events       = EPOLLIN;
+    p.tw           = &tw;
+    const auto h   = crhdl::from_promise(p);
+    p.timer.ud     = h.address();
+    tw.arm(p.timer, deadline::idle);
+    h.resume();
+    return h;
 }
 }
 
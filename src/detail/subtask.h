@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "../jutil.h"
+#include "server.h"
+
+//! @brief Composable awaitables for code running on a connection's coroutine
+//!
+//! A subtask<T> is a lazily started coroutine that a task (or another subtask) co_awaits for its
+//! result. Control is handed back and forth with symmetric transfer, so awaiting a subtask that
+//! doesn't need to wait for anything never returns to the event loop. A subtask may do socket I/O
+//! and sleep; the reactor resumes it directly, as each one knows the task it's running for (its
+//! root). Subtasks are owned by their subtask objects, so a connection going away (e.g., on a
+//! deadline) takes whatever it has in flight along with it.
+namespace pnen::detail
+{
+using namespace jutil;
+
+template <class T>
+struct subtask;
+
+//! @brief The result of a subtask<T> within when_all() and when_any()
+template <class T>
+using result_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+//! @brief Where subtasks started by when_all() or when_any() report their completion to
+struct join_state {
+    std::coroutine_handle<> parent;
+    std::size_t pending;             // completions until parent is resumed (+1 while starting)
+    bool any;                        // only the first completion counts
+    std::coroutine_handle<> first{}; // the subtask that completed first
+};
+
+struct subtask_promise_base {
+    task::promise_type *root_    = {};
+    std::coroutine_handle<> cont = {}; // the awaiting coroutine, unless started by a join
+    join_state *join             = {};
+    std::exception_ptr ex;
+
+    [[nodiscard]] static JUTIL_INLINE void *operator new(const std::size_t n)
+    {
+        return frame_pool::allocate(n);
+    }
+    static JUTIL_INLINE void operator delete(void *const p, const std::size_t n) noexcept
+    {
+        frame_pool::deallocate(p, n);
+    }
+    [[nodiscard]] JUTIL_INLINE task::promise_type &root() const noexcept { return *root_; }
+    constexpr JUTIL_INLINE std::suspend_always initial_suspend() const noexcept { return {}; }
+    JUTIL_INLINE void unhandled_exception() noexcept { ex = std::current_exception(); }
+
+    struct final_awaiter {
+        constexpr JUTIL_INLINE bool await_ready() const noexcept { return false; }
+        template <class P>
+        JUTIL_INLINE std::coroutine_handle<>
+        await_suspend(const std::coroutine_handle<P> h) const noexcept
+        {
+            auto &p = h.promise();
+            if (const auto j = p.join) {
+                if (j->any && j->first) return std::noop_coroutine();
+                j->first = h;
+                if (--j->pending) return std::noop_coroutine();
+                return j->parent;
+            }
+            return p.cont;
+        }
+        constexpr JUTIL_INLINE void await_resume() const noexcept {}
+    };
+    constexpr JUTIL_INLINE final_awaiter final_suspend() const noexcept { return {}; }
+
+    //! @brief Starts the subtask on behalf of given root, for it to report to given join
+    JUTIL_INLINE void start(const std::coroutine_handle<> h, task::promise_type &r,
+                            join_state &j) noexcept
+    {
+        root_ = &r;
+        join  = &j;
+        h.resume();
+    }
+};
+
+template <class T>
+struct subtask_promise : subtask_promise_base {
+    std::optional<T> value;
+    template <class U = T>
+    JUTIL_INLINE void return_value(U &&x) noexcept(std::is_nothrow_constructible_v<T, U>)
+    {
+        value.emplace(std::forward<U>(x));
+    }
+    [[nodiscard]] JUTIL_INLINE T result()
+    {
+        if (ex) std::rethrow_exception(ex);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct subtask_promise<void> : subtask_promise_base {
+    constexpr JUTIL_INLINE void return_void() const noexcept {}
+    JUTIL_INLINE void result() const
+    {
+        if (ex) std::rethrow_exception(ex);
+    }
+};
+
+//! @brief A coroutine yielding a T to the one that co_awaits it
+template <class T = void>
+struct [[nodiscard]] subtask {
+    struct promise_type : subtask_promise<T> {
+        JUTIL_INLINE subtask get_return_object() noexcept
+        {
+            return subtask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    handle h;
+
+    explicit subtask(const handle h_) noexcept : h{h_} {}
+    subtask(subtask &&o) noexcept : h{std::exchange(o.h, {})} {}
+    subtask &operator=(subtask &&) = delete;
+    ~subtask()
+    {
+        if (h) h.destroy();
+    }
+
+    struct awaiter {
+        handle h;
+        constexpr JUTIL_INLINE bool await_ready() const noexcept { return false; }
+        template <class P>
+        JUTIL_INLINE std::coroutine_handle<> await_suspend(const std::coroutine_handle<P> parent)
+        {
+            h.promise().root_ = &parent.promise().root();
+            h.promise().cont  = parent;
+            return h;
+        }
+        JUTIL_INLINE T await_resume() { return h.promise().result(); }
+    };
+    JUTIL_INLINE awaiter operator co_await() && noexcept { return {h}; }
+
+    //! @brief The result of the completed subtask, as when_all() and when_any() give it
+    [[nodiscard]] JUTIL_INLINE result_t<T> take()
+    {
+        if constexpr (std::is_void_v<T>) {
+            h.promise().result();
+            return {};
+        } else {
+            return h.promise().result();
+        }
+    }
+};
+
+template <class... Ts>
+struct when_all_awaitable {
+    std::tuple<subtask<Ts>...> ts;
+    join_state j;
+
+    constexpr JUTIL_INLINE bool await_ready() const noexcept { return !sizeof...(Ts); }
+    template <class P>
+    JUTIL_INLINE bool await_suspend(const std::coroutine_handle<P> parent) noexcept
+    {
+        j       = {.parent = parent, .pending = sizeof...(Ts) + 1, .any = false};
+        auto &r = parent.promise().root();
+        std::apply([&](auto &...t) { (t.h.promise().start(t.h, r, j), ...); }, ts);
+        return --j.pending;
+    }
+    JUTIL_INLINE std::tuple<result_t<Ts>...> await_resume()
+    {
+        return std::apply([](auto &...t) { return std::tuple<result_t<Ts>...>{t.take()...}; }, ts);
+    }
+};
+
+template <class... Ts>
+struct when_any_awaitable {
+    std::tuple<subtask<Ts>...> ts;
+    join_state j;
+
+    constexpr JUTIL_INLINE bool await_ready() const noexcept { return false; }
+    template <class P>
+    JUTIL_INLINE bool await_suspend(const std::coroutine_handle<P> parent) noexcept
+    {
+        // one completion plus the starting; once one completes, the rest needn't be started
+        j       = {.parent = parent, .pending = 2, .any = true};
+        auto &r = parent.promise().root();
+        std::apply([&](auto &...t) { ((j.first || (t.h.promise().start(t.h, r, j), 0)), ...); },
+                   ts);
+        return --j.pending;
+    }
+    JUTIL_INLINE std::variant<result_t<Ts>...> await_resume() { return take<0>(); }
+
+  private:
+    template <std::size_t I>
+    JUTIL_INLINE std::variant<result_t<Ts>...> take()
+    {
+        auto &t = std::get<I>(ts);
+        if constexpr (I + 1 < sizeof...(Ts))
+            if (t.h.address() != j.first.address()) return take<I + 1>();
+        return std::variant<result_t<Ts>...>{std::in_place_index<I>, t.take()};
+    }
+};
+
+//! @brief Runs subtasks concurrently, completing once all of them have
+//! @note At most one of them may be waiting on the connection's socket at a time
+//! @return Awaitable yielding a tuple of the results (std::monostate for void)
+template <class... Ts>
+[[nodiscard]] JUTIL_INLINE when_all_awaitable<Ts...> when_all(subtask<Ts>... ts) noexcept
+{
+    return {{std::move(ts)...}, {}};
+}
+
+//! @brief Runs subtasks concurrently, completing with the first of them to do so; the others are
+//!        destroyed along with the awaitable
+//! @note At most one of them may be waiting on the connection's socket at a time
+//! @return Awaitable yielding the result of the first subtask to complete, at its index
+template <class... Ts>
+    requires(sizeof...(Ts) > 0)
+[[nodiscard]] JUTIL_INLINE when_any_awaitable<Ts...> when_any(subtask<Ts>... ts) noexcept
+{
+    return {{std::move(ts)...}, {}};
+}
+
+struct sleep_awaitable : sleeper {
+    uint64_t ms;
+
+    explicit sleep_awaitable(const uint64_t ms_) noexcept : sleeper{}, ms{ms_} {}
+    NO_COPY_MOVE(sleep_awaitable);
+    ~sleep_awaitable()
+    {
+        if (root) root->tw->cancel(node);
+    }
+
+    constexpr JUTIL_INLINE bool await_ready() const noexcept { return false; }
+    template <class P>
+    JUTIL_INLINE void await_suspend(const std::coroutine_handle<P> h_) noexcept
+    {
+        h         = h_;
+        root      = &h_.promise().root();
+        node.kind = deadline::wake;
+        node.ud   = static_cast<sleeper *>(this);
+        root->tw->arm_in(node, ms);
+    }
+    constexpr JUTIL_INLINE void await_resume() const noexcept {}
+};
+
+//! @brief Suspends the awaiting coroutine for at least given time (in whole ticks of its reactor's
+//!        timer wheel); the connection's own deadline keeps running meanwhile
+[[nodiscard]] JUTIL_INLINE sleep_awaitable sleep_for(const std::chrono::milliseconds d) noexcept
+{
+    return sleep_awaitable{static_cast<uint64_t>(std::max(d.count(), decltype(d.count()){}))};
+}
+} // namespace pnen::detail
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <span>
+#include <stdint.h>
+#include <tls.h>
+
+#include "../jutil.h"
+
+//! @brief TLS session ticket keys shared by every reactor of the process, and optionally by other
+//!        processes through a key file
+//!
+//! Each reactor has a libtls config of its own, which would otherwise generate and rotate keys of
+//! its own; a client reconnecting to another reactor (or process) would then need a full
+//! handshake. Instead, keys come from a process-wide store, and each reactor's server context gets
+//! configured with them as they appear. A new key is due every half a session lifetime, its
+//! revision being the number of such periods since the epoch, so processes agree on when to
+//! rotate; with a key file, the first one to get its lock generates the key and the rest read it
+//! from there.
+namespace pnen::detail
+{
+using namespace jutil;
+
+//! @brief Starts the key store off, generating (or reading) the current key
+//! @param lifetime How long sessions can be resumed for (in s)
+//! @param file Where keys are shared with other processes; null to keep them to this one
+void tickets_start(uint32_t lifetime, const char *file);
+
+struct run_server_options;
+
+//! @brief A reactor's view of the key store, keeping the keys of its server context current
+//!
+//! Keys aren't added to the config the server context has, as handshakes on the handshake pool
+//! may be reading it meanwhile. The context is rather configured anew, between handshakes on the
+//! reactor, with a new config holding every key. Connections keep the config they were accepted
+//! with (libtls counts its references), so ones mid-handshake on a worker are unaffected.
+struct ticket_sync {
+    tls *ts;                     // the reactor's server context
+    const run_server_options *o; // for the configs of ts
+    std::span<uint8_t> key;      // private key of the certificate
+    uint32_t rev  = 0;           // newest key ts has been configured with
+    uint64_t next = 0;           // tick of the next check
+
+    //! @brief Configures ts with a new config, holding the keys if sessions can be resumed
+    //! @return Whether it succeeded; failures are logged
+    bool configure() noexcept;
+
+    //! @brief Rotates the keys if due, and configures ts anew if it lacks any; cheap if there's
+    //!        nothing to do
+    void sync() noexcept;
+
+    //! @brief Syncs about once a second
+    //! @param now The current tick of the reactor's timer wheel
+    JUTIL_INLINE void maintain(const uint64_t now) noexcept
+    {
+        if (now < next) [[likely]]
+            return;
+        next = now + 1000;
+        sync();
+    }
+};
+} // namespace pnen::detail
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
+#include <stdint.h>
+#include <time.h>
+#include <utility>
+
+#include "../jutil.h"
+
+namespace pnen::detail
+{
+using namespace jutil;
+
+//! @brief CLOCK_MONOTONIC in ns, for measuring durations
+[[nodiscard]] JUTIL_INLINE uint64_t mono_ns() noexcept
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+//! @brief CLOCK_MONOTONIC_COARSE in ms: as of the last scheduler tick, but cheap enough to call
+//!        for every write
+[[nodiscard]] JUTIL_INLINE uint64_t coarse_ms() noexcept
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+//! @brief What a connection is currently waiting for; each kind has its own timeout
+enum class deadline : uint8_t {
+    idle,   // for the next request to begin (also covers the handshake)
+    header, // for the rest of a request header, counted from its first byte
+    write,  // for the peer to take more of the response, counted from the last progress
+    body,   // for more of a request body, counted from the last progress
+    wake,   // not a deadline: a coroutine sleeping for a given time (see sleep_for())
+};
+
+//! @brief Intrusive timer wheel entry; linked into a slot list while armed
+struct timer_node {
+    timer_node *prev = nullptr, *next = nullptr;
+    uint64_t expiry  = 0; // tick on which the node expires
+    void *ud         = nullptr;
+    uint16_t slot    = 0; // level * nslots + slot index
+    deadline kind    = {};
+    [[nodiscard]] JUTIL_INLINE bool armed() const noexcept { return next; }
+};
+
+//! @brief Hierarchical timing wheel with millisecond ticks
+//!
+//! Arming and cancelling are O(1) list splices. A timer is cascaded to a lower level at most
+//! nlevels - 1 times before it expires, and per-level occupancy bitmaps make finding the next
+//! tick that needs attention O(nlevels). The owning event loop waits for timeout() ms, then calls
+//! update() and, after handling its events, expire().
+struct timer_wheel {
+    static constexpr unsigned nbits   = 6;
+    static constexpr unsigned nslots  = 1u << nbits;
+    static constexpr unsigned nlevels = 4;
+    static constexpr uint64_t span    = uint64_t{1} << (nbits * nlevels); // ~4.6 h of ticks
+
+    std::array<uint32_t, 4> ms; // timeout of each deadline kind
+    uint64_t now;               // last tick expire() has processed
+    uint64_t clock;             // tick as of last update()
+    std::size_t n = 0;          // armed timers
+    std::array<uint64_t, nlevels> used = {}; // bit i set = slots[l][i] is non-empty
+    timer_node slots[nlevels][nslots];       // circular list heads
+
+    explicit timer_wheel(const std::array<uint32_t, 4> ms_) noexcept
+        : ms{ms_}, now{ticks()}, clock{now}
+    {
+        for (auto &l : slots)
+            for (auto &h : l)
+                h.prev = h.next = &h;
+    }
+    NO_COPY_MOVE(timer_wheel);
+
+    [[nodiscard]] static JUTIL_INLINE uint64_t ticks() noexcept
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000 +
+               static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+    }
+
+    JUTIL_INLINE void update() noexcept { clock = ticks(); }
+
+    //! @brief (Re)arms t to expire after the timeout of given deadline kind (but wake)
+    JUTIL_INLINE void arm(timer_node &t, const deadline d) noexcept
+    {
+        t.kind = d;
+        arm_in(t, ms[std::to_underlying(d)]);
+    }
+
+    //! @brief (Re)arms t to expire in dt ms
+    JUTIL_INLINE void arm_in(timer_node &t, const uint64_t dt) noexcept
+    {
+        cancel(t);
+        t.expiry = std::min(clock + std::max(dt, uint64_t{1}), now + span - 1);
+        link(t);
+        ++n;
+    }
+
+    JUTIL_INLINE void cancel(timer_node &t) noexcept
+    {
+        if (t.armed()) unlink(t), --n;
+    }
+
+    //! @brief Time until the next tick that needs attention, in a form epoll_wait() takes
+    //! @return -1 if nothing is armed
+    [[nodiscard]] int timeout() const noexcept
+    {
+        if (!n) return -1;
+        auto best = std::numeric_limits<uint64_t>::max();
+        for (unsigned l = 0; l < nlevels; ++l) {
+            if (!used[l]) continue;
+            const auto sh  = nbits * l;
+            const auto pos = static_cast<int>((now >> sh) & (nslots - 1));
+            // rotate so that bit 0 stands for the slot after the current one
+            const auto k   = std::countr_zero(std::rotr(used[l], pos + 1)) + 1;
+            best           = std::min(best, ((now >> sh) + static_cast<uint64_t>(k)) << sh);
+        }
+        return best <= clock ? 0
+                             : static_cast<int>(std::min<uint64_t>(
+                                   best - clock, std::numeric_limits<int>::max()));
+    }
+
+    //! @brief Processes every tick up to the last update(), calling f(timer_node &) on expired
+    //!        timers; f may arm and cancel timers (including the one it's given)
+    template <class F>
+    void expire(F &&f)
+    {
+        while (now < clock) {
+            if (!n) {
+                now = clock;
+                break;
+            }
+            ++now;
+            for (unsigned l = 1; l < nlevels && !(now & ((uint64_t{1} << (nbits * l)) - 1)); ++l)
+                cascade(l, static_cast<unsigned>((now >> (nbits * l)) & (nslots - 1)));
+            auto &h = slots[0][now & (nslots - 1)];
+            while (h.next != &h) {
+                auto &t = *h.next;
+                unlink(t);
+                --n;
+                f(t);
+            }
+        }
+    }
+
+  private:
+    JUTIL_INLINE void link(timer_node &t) noexcept
+    {
+        const auto d = t.expiry - now;
+        unsigned l   = 0;
+        while (l + 1 < nlevels && d >= (uint64_t{1} << (nbits * (l + 1))))
+            ++l;
+        const auto i = static_cast<unsigned>((t.expiry >> (nbits * l)) & (nslots - 1));
+        auto &h      = slots[l][i];
+        t.slot       = static_cast<uint16_t>(l * nslots + i);
+        t.prev       = h.prev;
+        t.next       = &h;
+        h.prev->next = &t;
+        h.prev       = &t;
+        used[l] |= uint64_t{1} << i;
+    }
+
+    JUTIL_INLINE void unlink(timer_node &t) noexcept
+    {
+        t.prev->next = t.next;
+        t.next->prev = t.prev;
+        if (t.prev == t.next) // list is down to its head
+            used[t.slot / nslots] &= ~(uint64_t{1} << (t.slot % nslots));
+        t.prev = t.next = nullptr;
+    }
+
+    //! @brief Redistributes the timers of a higher-level slot that has come due
+    JUTIL_INLINE void cascade(const unsigned l, const unsigned i) noexcept
+    {
+        auto &h = slots[l][i];
+        if (h.next == &h) return;
+        auto t       = h.next;
+        h.prev->next = nullptr;
+        h.prev = h.next = &h;
+        used[l] &= ~(uint64_t{1} << i);
+        while (t) {
+            const auto nx = t->next;
+            link(*t);
+            t = nx;
+        }
+    }
+};
+} // namespace pnen::detail
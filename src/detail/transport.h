@@ -0,0 +1,352 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <tls.h>
+#include <unistd.h>
+#include <utility>
+
+#include "../jutil.h"
+#include "../vocabserv.h"
+#include "timer.h"
+
+//! @brief Byte streams a connection's coroutine can run over
+//!
+//! A transport reads and writes like tls_read()/tls_write(): a byte count, 0 on EOF (reads only),
+//! -1 on error, or want_in/want_out when the call needs the socket to become readable/writable
+//! before it can make progress. Transports own their underlying resources and release them when
+//! destroyed, so moving one into a coroutine frame ties the connection's lifetime to it.
+namespace pnen::detail
+{
+using namespace jutil;
+
+inline constexpr ssize_t want_in  = TLS_WANT_POLLIN;
+inline constexpr ssize_t want_out = TLS_WANT_POLLOUT;
+
+// clang-format off
+template <class T>
+concept transport = std::move_constructible<T> && requires (T &t, void *p, const void *cp,
+                                                            std::size_t n) {
+    { t.read(p, n) } noexcept -> std::same_as<ssize_t>;
+    { t.write(cp, n) } noexcept -> std::same_as<ssize_t>;
+};
+//! @brief A transport that can send file contents without them passing through userspace
+//!
+//! sendfile(fd, off, n) works like write() (e.g., want_out), sending from fd at off, which it
+//! advances by the amount sent.
+template <class T>
+concept file_transport = transport<T> && requires (T &t, int fd, off_t &off, std::size_t n) {
+    { t.sendfile(fd, off, n) } noexcept -> std::same_as<ssize_t>;
+};
+//! @brief A transport that can hold writes back to send them along with what's written next
+//!
+//! write_more() works like write(), but what it takes may stay buffered until the next write();
+//! the last write of a response is therefore to be a write().
+template <class T>
+concept corking_transport = transport<T> && requires (T &t, const void *cp, std::size_t n) {
+    { t.write_more(cp, n) } noexcept -> std::same_as<ssize_t>;
+};
+//! @brief A transport that can write several buffers with one call
+//!
+//! writev(iov, n, more) works like write() on the buffers' concatenation, more being the hint of
+//! write_more().
+template <class T>
+concept gather_transport = transport<T> && requires (T &t, const iovec *iov, int n, bool more) {
+    { t.writev(iov, n, more) } noexcept -> std::same_as<ssize_t>;
+};
+//! @brief A transport with a handshake that can be driven on its own (see handshake())
+//!
+//! handshake() takes it a step further: 0 once complete, otherwise like read(). fd is the socket,
+//! or -1 if the transport doesn't do its own socket I/O, in which case it's waited on as a read is.
+template <class T>
+concept handshake_transport = transport<T> && requires (T &t) {
+    { t.handshake() } noexcept -> std::same_as<ssize_t>;
+    { t.fd } -> std::convertible_to<int>;
+};
+//! @brief A transport whose handshake may have negotiated an application protocol (ALPN)
+//!
+//! alpn() is the protocol selected, or empty if none was (e.g., the client offered none).
+template <class T>
+concept alpn_transport = transport<T> && requires (const T &t) {
+    { t.alpn() } noexcept -> std::convertible_to<std::string_view>;
+};
+// clang-format on
+
+//! @brief Plaintext TCP: the socket is read and written directly
+struct tcp_transport {
+    int fd;
+
+    explicit tcp_transport(const int fd_) noexcept : fd{fd_} {}
+    tcp_transport(tcp_transport &&o) noexcept : fd{std::exchange(o.fd, -1)} {}
+    tcp_transport &operator=(tcp_transport &&) = delete;
+    ~tcp_transport()
+    {
+        if (fd != -1) CHECK(close(fd), != -1);
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t read(void *const buf, const std::size_t n) noexcept
+    {
+        ssize_t ret;
+        while ((ret = ::recv(fd, buf, n, 0)) == -1 && errno == EINTR)
+            ;
+        return ret == -1 && errno == EAGAIN ? want_in : ret;
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t write(const void *const buf, const std::size_t n) noexcept
+    {
+        ssize_t ret;
+        while ((ret = ::send(fd, buf, n, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+            ;
+        return ret == -1 && errno == EAGAIN ? want_out : ret;
+    }
+
+    //! @note The kernel holds partial segments back until a write without MSG_MORE
+    [[nodiscard]] JUTIL_INLINE ssize_t write_more(const void *const buf,
+                                                  const std::size_t n) noexcept
+    {
+        ssize_t ret;
+        while ((ret = ::send(fd, buf, n, MSG_NOSIGNAL | MSG_MORE)) == -1 && errno == EINTR)
+            ;
+        return ret == -1 && errno == EAGAIN ? want_out : ret;
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t writev(const iovec *const iov, const int n,
+                                              const bool more) noexcept
+    {
+        msghdr mh{};
+        mh.msg_iov    = const_cast<iovec *>(iov);
+        mh.msg_iovlen = static_cast<std::size_t>(n);
+        ssize_t ret;
+        while ((ret = ::sendmsg(fd, &mh, MSG_NOSIGNAL | (more ? MSG_MORE : 0))) == -1 &&
+               errno == EINTR)
+            ;
+        return ret == -1 && errno == EAGAIN ? want_out : ret;
+    }
+
+    //! @note The file is sent from the page cache, never copied into userspace
+    [[nodiscard]] JUTIL_INLINE ssize_t sendfile(const int in, off_t &off,
+                                                const std::size_t n) noexcept
+    {
+        ssize_t ret;
+        while ((ret = ::sendfile(fd, in, &off, n)) == -1 && errno == EINTR)
+            ;
+        return ret == -1 && errno == EAGAIN ? want_out : ret;
+    }
+};
+
+//! @brief Handshake statistics of every TLS connection so far
+struct tls_stats {
+    uint64_t handshakes;   // completed
+    uint64_t resumed;      // of which resumed a session (i.e., were abbreviated)
+    uint64_t handshake_us; // from accept to completion, in total
+};
+
+//! @brief Accounts for the handshake of tc having completed, since given mono_ns()
+void tls_established(tls *tc, uint64_t since) noexcept;
+
+[[nodiscard]] tls_stats tls_totals() noexcept;
+
+//! @brief TLS through libtls, which either does the socket I/O itself or goes through callbacks
+//!
+//! Writes are cut into small records while the connection is fresh, or fresh again after having
+//! been idle: a record can only be decrypted once all of it has arrived, and while the congestion
+//! window is small, a full-sized one spans several round trips. Past boost_after bytes, records
+//! grow to full size, which costs less per byte. Small writes flagged as having more to follow
+//! (write_more()) are held back and sent in one record with what follows.
+struct tls_transport {
+    static constexpr std::size_t small_record = 1400; // with record overhead, fits one segment
+    static constexpr std::size_t full_record  = 16 * 1024;
+    static constexpr uint64_t boost_after     = 64 * 1024; // bytes sent before records grow
+    static constexpr uint64_t idle_reset      = 1000;      // ms without writes before they shrink
+
+    tls *tc;
+    int fd;         // closed along with tc; -1 if the socket is owned elsewhere (i.e., by io_uring)
+    uint64_t since; // mono_ns() of accept; 0 once the handshake has completed
+    uint64_t nsent    = 0; // bytes written since the connection was last idle
+    uint64_t last     = 0; // coarse_ms() of the last write
+    std::size_t retry = 0; // length of the tls_write() to be repeated, which libtls requires
+    std::size_t taken = 0; // bytes of the current write that were appended to pending
+    std::string pending;   // held back by write_more(); at most a record's worth
+
+    tls_transport(tls *const tc_, const int fd_) noexcept : tc{tc_}, fd{fd_}, since{mono_ns()} {}
+    tls_transport(tls_transport &&o) noexcept
+        : tc{std::exchange(o.tc, nullptr)}, fd{std::exchange(o.fd, -1)},
+          since{std::exchange(o.since, 0)}, nsent{o.nsent}, last{o.last}, retry{o.retry},
+          taken{o.taken}, pending{std::move(o.pending)}
+    {
+    }
+    tls_transport &operator=(tls_transport &&) = delete;
+    ~tls_transport()
+    {
+        if (!tc) return;
+        CHECK(tls_close(tc), != -1);
+        if (fd != -1) CHECK(close(fd), != -1);
+        tls_free(tc);
+    }
+
+    // The handshake is driven explicitly rather than left to tls_read()/tls_write(), so that its
+    // completion can be told apart from there being no application data yet.
+    [[nodiscard]] JUTIL_INLINE ssize_t read(void *const buf, const std::size_t n) noexcept
+    {
+        if (since) [[unlikely]]
+            if (const auto ret = handshake()) return ret;
+        return tls_read(tc, buf, n);
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t write(const void *const buf, const std::size_t n) noexcept
+    {
+        if (since) [[unlikely]]
+            if (const auto ret = handshake()) return ret;
+        if (!retry) {
+            const auto now = coarse_ms();
+            if (now - last > idle_reset) nsent = 0;
+            last = now;
+        }
+        if (!pending.empty()) return flush(buf, n);
+        const auto m = retry ? retry : std::min(n, record());
+        return sent(tls_write(tc, buf, m), m);
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t write_more(const void *const buf,
+                                                  const std::size_t n) noexcept
+    {
+        if (retry || pending.size() + n > record()) return write(buf, n);
+        pending.append(static_cast<const char *>(buf), n);
+        return static_cast<ssize_t>(n);
+    }
+
+    [[nodiscard]] JUTIL_INLINE std::string_view alpn() const noexcept
+    {
+        const auto p = tls_conn_alpn_selected(tc);
+        return p ? p : std::string_view{};
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t handshake() noexcept
+    {
+        if (!since) return 0;
+        const auto ret = tls_handshake(tc);
+        if (ret == 0) tls_established(tc, std::exchange(since, 0));
+        return ret;
+    }
+
+  private:
+    [[nodiscard]] JUTIL_INLINE std::size_t record() const noexcept
+    {
+        return nsent < boost_after ? small_record : full_record;
+    }
+
+    //! @brief Accounts for a tls_write() of m bytes having returned ret
+    JUTIL_INLINE ssize_t sent(const ssize_t ret, const std::size_t m) noexcept
+    {
+        if (ret == want_in || ret == want_out) return retry = m, ret;
+        retry = 0;
+        if (ret > 0) nsent += static_cast<uint64_t>(ret);
+        return ret;
+    }
+
+    //! @brief Sends what's pending, topped up to a record with the head of buf
+    //! @return How much of buf went out, which may be none if pending was a record's worth
+    ssize_t flush(const void *const buf, const std::size_t n) noexcept
+    {
+        if (!retry) {
+            taken = std::min(n, record() - std::min(record(), pending.size()));
+            pending.append(static_cast<const char *>(buf), taken);
+        }
+        const auto ret = sent(tls_write(tc, pending.data(), pending.size()), pending.size());
+        if (ret <= 0) return ret;
+        // pending fits a single record, which libtls writes all of once it writes any
+        pending.clear();
+        return static_cast<ssize_t>(std::exchange(taken, 0));
+    }
+};
+
+//! @brief One direction of an in-memory connection
+struct mem_pipe {
+    std::string data;
+    std::size_t off = 0;     // bytes of data already read
+    bool closed     = false; // the writing end has gone away
+};
+
+//! @brief In-memory connection, e.g. for driving a handler without sockets
+//! @note There is no readiness notification: whoever writes into in is to resume the coroutine
+//!       if it waits for reading (see connect_mem())
+struct mem_transport {
+    mem_pipe *in, *out;
+
+    mem_transport(mem_pipe &in_, mem_pipe &out_) noexcept : in{&in_}, out{&out_} {}
+    mem_transport(mem_transport &&o) noexcept
+        : in{std::exchange(o.in, nullptr)}, out{std::exchange(o.out, nullptr)}
+    {
+    }
+    mem_transport &operator=(mem_transport &&) = delete;
+    ~mem_transport()
+    {
+        if (out) out->closed = true;
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t read(void *const buf, const std::size_t n) noexcept
+    {
+        if (in->off == in->data.size()) return in->closed ? 0 : want_in;
+        const auto m = std::min(n, in->data.size() - in->off);
+        memcpy(buf, in->data.data() + in->off, m);
+        if ((in->off += m) == in->data.size()) in->data.clear(), in->off = 0;
+        return static_cast<ssize_t>(m);
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t write(const void *const buf, const std::size_t n) noexcept
+    {
+        out->data.append(static_cast<const char *>(buf), n);
+        return static_cast<ssize_t>(n);
+    }
+};
+
+//! @brief In-memory connection with a handshake that negotiates a protocol, as TLS with ALPN does,
+//!        e.g. for driving a handler the way it's driven over TLS
+//!
+//! The handshake takes the first byte the client sends, a stand-in for its ClientHello; proto is
+//! the protocol negotiated then, and alpn() is empty until it's complete.
+struct mem_alpn_transport : mem_transport {
+    int fd = -1; // as for tls_transport over io_uring, the handshake is waited on as a read is
+    std::string_view proto;
+    bool established = false;
+
+    mem_alpn_transport(mem_pipe &in_, mem_pipe &out_, const std::string_view proto_) noexcept
+        : mem_transport{in_, out_}, proto{proto_}
+    {
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t read(void *const buf, const std::size_t n) noexcept
+    {
+        if (const auto ret = handshake()) return ret;
+        return mem_transport::read(buf, n);
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t write(const void *const buf, const std::size_t n) noexcept
+    {
+        if (const auto ret = handshake()) return ret;
+        return mem_transport::write(buf, n);
+    }
+
+    [[nodiscard]] JUTIL_INLINE std::string_view alpn() const noexcept
+    {
+        return established ? proto : std::string_view{};
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t handshake() noexcept
+    {
+        if (established) return 0;
+        char hello;
+        if (const auto ret = mem_transport::read(&hello, 1); ret != 1) return ret ? ret : -1;
+        established = true;
+        return 0;
+    }
+};
+} // namespace pnen::detail
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <coroutine>
+#include <errno.h>
+#include <liburing.h>
+#include <memory>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <tls.h>
+#include <vector>
+
+#include "../buffer.h"
+#include "../jutil.h"
+#include "../vocabserv.h"
+#include "transport.h"
+
+#include "../lmacro_begin.h"
+
+//! @brief io_uring reactor backend (Linux >= 5.19, liburing >= 2.4)
+//!
+//! Transports work on memory rather than the socket: libtls is given read/write callbacks
+//! (tls_accept_cbs), and plaintext goes through the same functions (uring_transport). Reads are
+//! served from the provided buffer a recv completed into, and writes are appended to a
+//! per-connection send buffer. The reactor then submits every recv/send/accept of an
+//! iteration with the same io_uring_enter() that waits for the next completions.
+namespace pnen::detail
+{
+using namespace jutil;
+
+struct uring_reactor;
+
+struct uring_conn {
+    static constexpr std::size_t txcap = 64 * 1024; // above this, writes report want_out
+
+    uring_reactor &r;
+    int fd;
+    std::coroutine_handle<> h = {}; // null once the coroutine is gone
+    const uint32_t *want      = {}; // direction the suspended coroutine waits on
+    uint32_t nref             = 0;  // in-flight SQEs referring to this connection
+    bool rx_armed = false, eof = false, broken = false, dirty = false;
+
+    // rx: the provided buffer the last recv completed into
+    int32_t rx_bid  = -1;
+    uint32_t rx_off = 0, rx_len = 0;
+
+    // tx: double buffered; libtls appends to tx[txi] while tx[txi ^ 1] may be in flight
+    buffer tx[2];
+    uint8_t txi     = 0;
+    bool tx_busy    = false;
+    uint32_t tx_off = 0;
+
+    uring_conn(uring_reactor &r_, const int fd_) noexcept : r{r_}, fd{fd_} {}
+    NO_COPY_MOVE(uring_conn);
+
+    static ssize_t read_cb(tls *, void *buf, size_t n, void *arg) noexcept;
+    static ssize_t write_cb(tls *, const void *buf, size_t n, void *arg) noexcept;
+
+    //! @brief Called as the coroutine goes away; pending output is still flushed before closing
+    void detach() noexcept;
+};
+
+enum class uring_op : uint64_t { accept, recv, send, ignore, notify };
+
+struct uring_reactor {
+    static constexpr unsigned nentries = 4096;
+    static constexpr unsigned nbufs    = 4096;
+    static constexpr unsigned bufsz    = 4096;
+    static constexpr int bgid          = 0;
+
+    io_uring ring;
+    io_uring_buf_ring *br = nullptr;
+    std::unique_ptr<char[]> bufs;
+    std::vector<uring_conn *> dirty; // connections with unsent output; flushed before submitting
+
+    uring_reactor()                                 = default;
+    uring_reactor(const uring_reactor &)            = delete;
+    uring_reactor &operator=(const uring_reactor &) = delete;
+    ~uring_reactor()
+    {
+        if (br) io_uring_free_buf_ring(&ring, br, nbufs, bgid);
+        if (bufs) io_uring_queue_exit(&ring);
+    }
+
+    [[nodiscard]] bool init() noexcept
+    {
+        if (const auto err = io_uring_queue_init(nentries, &ring, 0); err < 0) {
+            g_log.error("io_uring_queue_init() failed: ", strerror(-err));
+            return false;
+        }
+        bufs = std::make_unique_for_overwrite<char[]>(std::size_t{nbufs} * bufsz);
+        int err;
+        if (br = io_uring_setup_buf_ring(&ring, nbufs, bgid, 0, &err); !br) {
+            g_log.error("io_uring_setup_buf_ring() failed: ", strerror(-err));
+            return false;
+        }
+        for (unsigned i = 0; i < nbufs; ++i)
+            io_uring_buf_ring_add(br, buf(i), bufsz, static_cast<unsigned short>(i),
+                                  io_uring_buf_ring_mask(nbufs), static_cast<int>(i));
+        io_uring_buf_ring_advance(br, nbufs);
+        dirty.reserve(256);
+        return true;
+    }
+
+    [[nodiscard]] JUTIL_INLINE char *buf(const unsigned bid) const noexcept
+    {
+        return &bufs[std::size_t{bid} * bufsz];
+    }
+
+    //
+    // SQE preparation
+    //
+
+    static JUTIL_INLINE uint64_t tag(uring_conn *c, const uring_op op) noexcept
+    {
+        return to_uint(c) | std::to_underlying(op);
+    }
+    static JUTIL_INLINE std::pair<uring_conn *, uring_op> untag(const uint64_t x) noexcept
+    {
+        return {static_cast<uring_conn *>(to_ptr(x & ~uint64_t{7})), static_cast<uring_op>(x & 7)};
+    }
+
+    [[nodiscard]] JUTIL_INLINE io_uring_sqe *sqe(const uint64_t data) noexcept
+    {
+        auto s = io_uring_get_sqe(&ring);
+        if (!s) [[unlikely]] { // SQ full: push it to the kernel without waiting
+            io_uring_submit(&ring);
+            s = CHECK(io_uring_get_sqe(&ring));
+        }
+        io_uring_sqe_set_data64(s, data);
+        return s;
+    }
+
+    JUTIL_INLINE void arm_accept(const int acfd) noexcept
+    {
+        io_uring_prep_multishot_accept(sqe(tag(nullptr, uring_op::accept)), acfd, nullptr, nullptr,
+                                       0);
+    }
+
+    //! @brief Watches an eventfd (of an offload_port) for becoming readable, once
+    JUTIL_INLINE void arm_notify(const int efd) noexcept
+    {
+        io_uring_prep_poll_add(sqe(tag(nullptr, uring_op::notify)), efd, POLLIN);
+    }
+
+    JUTIL_INLINE void arm_recv(uring_conn &c) noexcept
+    {
+        if (c.rx_armed) return;
+        const auto s = sqe(tag(&c, uring_op::recv));
+        io_uring_prep_recv(s, c.fd, nullptr, bufsz, 0);
+        s->flags |= IOSQE_BUFFER_SELECT;
+        s->buf_group = bgid;
+        c.rx_armed   = true;
+        ++c.nref;
+    }
+
+    JUTIL_INLINE void send(uring_conn &c) noexcept
+    {
+        const auto &b = c.tx[c.txi ^ 1];
+        io_uring_prep_send(sqe(tag(&c, uring_op::send)), c.fd, b.data() + c.tx_off,
+                           b.size() - c.tx_off, MSG_NOSIGNAL);
+        ++c.nref;
+    }
+
+    JUTIL_INLINE void recycle(uring_conn &c) noexcept
+    {
+        const auto bid = static_cast<unsigned short>(c.rx_bid);
+        io_uring_buf_ring_add(br, buf(bid), bufsz, bid, io_uring_buf_ring_mask(nbufs), 0);
+        io_uring_buf_ring_advance(br, 1);
+        c.rx_bid = -1;
+    }
+
+    JUTIL_INLINE void mark_dirty(uring_conn &c) noexcept
+    {
+        if (!c.dirty) c.dirty = true, dirty.push_back(&c);
+    }
+
+    //! @brief Queues a send for every connection that has produced output since last flush
+    void flush() noexcept
+    {
+        for (const auto c : dirty) {
+            c->dirty = false;
+            if (c->broken || c->tx_busy || !c->tx[c->txi].size()) continue;
+            c->tx_busy = true;
+            c->tx_off  = 0;
+            c->txi ^= 1;
+            send(*c);
+        }
+        dirty.clear();
+    }
+
+    //! @brief Frees a detached connection once nothing refers to it anymore
+    //! @return Whether the connection was released
+    bool settle(uring_conn &c) noexcept
+    {
+        if (c.h || c.nref || c.dirty || (!c.broken && c.tx[c.txi].size())) return false;
+        if (c.rx_bid != -1) recycle(c);
+        io_uring_prep_close(sqe(tag(nullptr, uring_op::ignore)), c.fd);
+        delete &c;
+        return true;
+    }
+
+    //
+    // completion handling (everything but accept)
+    //
+
+    //! @brief Handles a recv or send completion
+    //! @return Whether the coroutine should be resumed
+    [[nodiscard]] bool complete(uring_conn &c, const uring_op op, const io_uring_cqe &cqe) noexcept
+    {
+        --c.nref;
+        switch (op) {
+        case uring_op::recv:
+            c.rx_armed = false;
+            if (cqe.res > 0) [[likely]] {
+                c.rx_bid = static_cast<int32_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                c.rx_off = 0;
+                c.rx_len = static_cast<uint32_t>(cqe.res);
+            } else if (cqe.res == -ENOBUFS) { // ring ran dry; try again with the next submit
+                if (c.h) arm_recv(c);
+                return false;
+            } else if (cqe.res != -ECANCELED) {
+                c.eof    = true;
+                c.broken = cqe.res < 0;
+            }
+            return c.h && *c.want == EPOLLIN;
+        case uring_op::send:
+            if (cqe.res < 0) {
+                c.broken = true;
+                c.tx[0].clear(), c.tx[1].clear();
+                c.tx_busy = false;
+            } else if (c.tx_off += static_cast<uint32_t>(cqe.res);
+                       c.tx_off < c.tx[c.txi ^ 1].size()) {
+                send(c); // partial send
+                return false;
+            } else {
+                c.tx[c.txi ^ 1].clear();
+                c.tx_busy = false;
+                if (c.tx[c.txi].size()) mark_dirty(c);
+            }
+            return c.h && *c.want == EPOLLOUT;
+        default: return false;
+        }
+    }
+};
+
+inline ssize_t uring_conn::read_cb(tls *, void *const buf, const size_t n, void *const arg) noexcept
+{
+    auto &c = *static_cast<uring_conn *>(arg);
+    if (c.rx_bid == -1) {
+        if (c.eof) return c.broken ? -1 : 0;
+        c.r.arm_recv(c);
+        return want_in;
+    }
+    const auto m = std::min(n, std::size_t{c.rx_len - c.rx_off});
+    memcpy(buf, c.r.buf(static_cast<unsigned>(c.rx_bid)) + c.rx_off, m);
+    if ((c.rx_off += static_cast<uint32_t>(m)) == c.rx_len) c.r.recycle(c);
+    return static_cast<ssize_t>(m);
+}
+
+inline ssize_t uring_conn::write_cb(tls *, const void *const buf, const size_t n,
+                                    void *const arg) noexcept
+{
+    auto &c = *static_cast<uring_conn *>(arg);
+    if (c.broken) return -1;
+    auto &b = c.tx[c.txi];
+    if (b.size() >= txcap) return want_out;
+    b.append(std::string_view{static_cast<const char *>(buf), n});
+    c.r.mark_dirty(c);
+    return static_cast<ssize_t>(n);
+}
+
+inline void uring_conn::detach() noexcept
+{
+    h = {};
+    if (rx_armed)
+        io_uring_prep_cancel64(r.sqe(r.tag(nullptr, uring_op::ignore)),
+                               r.tag(this, uring_op::recv), 0);
+}
+
+//! @brief Plaintext over a uring_conn; the connection outlives it (see uring_conn::detach())
+struct uring_transport {
+    uring_conn *c;
+
+    [[nodiscard]] JUTIL_INLINE ssize_t read(void *const buf, const std::size_t n) noexcept
+    {
+        return uring_conn::read_cb(nullptr, buf, n, c);
+    }
+
+    [[nodiscard]] JUTIL_INLINE ssize_t write(const void *const buf, const std::size_t n) noexcept
+    {
+        return uring_conn::write_cb(nullptr, buf, n, c);
+    }
+};
+} // namespace pnen::detail
+
+#include "../lmacro_end.h"
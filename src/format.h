@@ -306,7 +306,7 @@ struct format_impl {
     template <std::size_t N, class... Rest>
     static JUTIL_CI char *format(char *const d_f, const char (*const x)[N], Rest &&...rest) noexcept
     {
-        return format_impl::format(std::copy_n(*x, N - 1, d_f), static_cast<Rest &&>(rest)...);
+        return format_impl::format(std::copy_n(*x, N, d_f), static_cast<Rest &&>(rest)...);
     }
 
     template <class... Rest>
@@ -411,7 +411,7 @@ struct format_impl {
         d_f[N - M - 1] = radix_100_table[int(y >> 32) * 2 + 1];                                    \
     else if constexpr (N > M + 1)                                                                  \
         memcpy(d_f + (N - M - 2), radix_100_table + int(y >> 32) * 2, 2);                          \
-    y *= 100;
+    y = static_cast<uint32_t>(y) * uint64_t{100};
         EAT_NUM(8);
         EAT_NUM(6);
         EAT_NUM(4);
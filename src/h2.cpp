@@ -0,0 +1,354 @@
+#include "h2.h"
+
+#include <algorithm>
+#include <array>
+#include <string.h>
+
+#include "lmacro_begin.h"
+
+using namespace jutil;
+
+namespace h2
+{
+namespace
+{
+//
+// static table
+//
+
+struct static_entry {
+    std::string_view name, value;
+};
+
+//! @brief Fields with indices 1-61 (RFC 7541, Appendix A)
+constexpr static_entry static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+constexpr std::size_t static_size = std::size(static_table);
+
+//
+// Huffman code
+//
+
+//! @brief Code lengths of symbols 0-256 (RFC 7541, Appendix B); the code is canonical, so these
+//!        are enough to tell the codes apart
+constexpr uint8_t huff_len[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 30, 28,
+    28, 28, 28, 28, 28, 28, 28, 28, 6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10, 13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6, 15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28, 20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23,
+    23, 23, 23, 24, 23, 24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24, 22, 21, 20,
+    22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, 21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22,
+    22, 23, 22, 22, 23, 26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25, 19, 21, 26,
+    27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27, 20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25,
+    25, 24, 24, 26, 23, 26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26, 30
+};
+
+//! @brief The code in canonical form: for each length, the first code of that length, how many
+//!        there are, and where their symbols begin in syms
+struct canonical {
+    uint32_t first[31]  = {};
+    uint16_t count[31]  = {};
+    uint16_t offset[31] = {};
+    uint16_t syms[257]  = {};
+};
+
+constexpr canonical huff = [] {
+    canonical c;
+    for (const auto l : huff_len)
+        ++c.count[l];
+    for (uint32_t l = 1, code = 0, off = 0; l < 31; ++l) {
+        code        = (code + c.count[l - 1]) << 1;
+        c.first[l]  = code;
+        c.offset[l] = static_cast<uint16_t>(off);
+        off += c.count[l];
+    }
+    c.count[0] = 0;
+    uint16_t at[31];
+    std::copy_n(c.offset, 31, at);
+    for (uint16_t s = 0; s < 257; ++s)
+        c.syms[at[huff_len[s]]++] = s;
+    return c;
+}();
+static_assert(huff.first[5] == 0 && huff.count[5] == 10 && huff.first[30] == 0x3ffffffc);
+
+//! @brief Decodes a Huffman-coded string, appending it to out
+//! @return Whether the string was valid, i.e., had no EOS and was padded with at most 7 1-bits
+bool huff_decode(const std::string_view s, std::string &out)
+{
+    uint32_t code = 0, len = 0;
+    for (const auto ch : s)
+        for (int i = 7; i >= 0; --i) {
+            code = code << 1 | (static_cast<uint8_t>(ch) >> i & 1);
+            if (++len < 5) continue;
+            if (const auto i_ = code - huff.first[len]; i_ < huff.count[len]) {
+                const auto sym = huff.syms[huff.offset[len] + i_];
+                if (sym == 256) return false;
+                out += static_cast<char>(sym);
+                code = len = 0;
+            } else if (len == 30) {
+                return false;
+            }
+        }
+    return len < 8 && code == (1u << len) - 1;
+}
+
+//
+// primitives
+//
+
+//! @brief Reads an integer with an n-bit prefix (RFC 7541, 5.1)
+//! @return Whether the integer was whole and no more than 2^32
+bool read_int(const char *&f, const char *const l, const int n, uint32_t &x) noexcept
+{
+    const uint32_t max = (1u << n) - 1;
+    x                  = static_cast<uint8_t>(*f++) & max;
+    if (x < max) return true;
+    for (int m = 0; f != l && m <= 28; m += 7) {
+        const auto b = static_cast<uint8_t>(*f++);
+        x += uint32_t{b & 0x7fu} << m;
+        if (!(b & 0x80)) return x >= max;
+    }
+    return false;
+}
+
+//! @brief Writes an integer with an n-bit prefix, the rest of the first byte being bits
+void write_int(std::string &out, const int n, const uint8_t bits, uint32_t x)
+{
+    const uint32_t max = (1u << n) - 1;
+    if (x < max) {
+        out += static_cast<char>(bits | x);
+        return;
+    }
+    out += static_cast<char>(bits | max);
+    for (x -= max; x >= 0x80; x >>= 7)
+        out += static_cast<char>(x | 0x80);
+    out += static_cast<char>(x);
+}
+
+//! @brief Reads a string literal (RFC 7541, 5.2), Huffman-decoding it if need be
+//! @param buf Where a decoded string is kept; the result points into the block otherwise
+bool read_str(const char *&f, const char *const l, std::string &buf, std::string_view &s)
+{
+    if (f == l) return false;
+    const bool huffman = *f & 0x80;
+    uint32_t n;
+    if (!read_int(f, l, 7, n) || static_cast<std::size_t>(l - f) < n) return false;
+    s = {f, n};
+    f += n;
+    if (!huffman) return true;
+    buf.clear();
+    if (!huff_decode(s, buf)) return false;
+    s = buf;
+    return true;
+}
+
+//! @brief Writes a string literal as is
+void write_str(std::string &out, const std::string_view s)
+{
+    write_int(out, 7, 0, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+//! @brief Whether a field can be given as an HTTP/1.1 header line
+bool is_valid(const std::string_view name, const std::string_view value) noexcept
+{
+    if (name.empty()) return false;
+    for (std::size_t i = 0; const auto c : name)
+        if ((c >= 'A' && c <= 'Z') || c == '\r' || c == '\n' || c == '\0' || c == ' ' ||
+            (c == ':' && i++))
+            return false;
+    return std::ranges::none_of(value, L(x == '\r' || x == '\n' || x == '\0'));
+}
+} // namespace
+
+//
+// decoder
+//
+
+void decoder::evict(const std::size_t cap) noexcept
+{
+    while (size_ > cap) {
+        const auto &[n, v] = dyn_.back();
+        size_ -= n.size() + v.size() + 32;
+        dyn_.pop_back();
+    }
+}
+
+void decoder::insert(const std::string_view name, const std::string_view value)
+{
+    const auto sz = name.size() + value.size() + 32;
+    if (sz > cap_) {
+        evict(0);
+        return;
+    }
+    evict(cap_ - sz);
+    dyn_.emplace_front(name, value);
+    size_ += sz;
+}
+
+error_code decoder::decode(const std::string_view block, std::string &out, const std::size_t max)
+{
+    const char *f = block.data(), *const l = f + block.size();
+    std::string nbuf, vbuf;
+    auto err          = error_code::no_error;
+    std::size_t nlist = 0;
+    const auto entry = [&](const uint32_t i, std::string_view &n, std::string_view &v) {
+        if (i == 0) return false;
+        if (i <= static_size) {
+            n = static_table[i - 1].name, v = static_table[i - 1].value;
+            return true;
+        }
+        if (i - static_size > dyn_.size()) return false;
+        const auto &[dn, dv] = dyn_[i - static_size - 1];
+        n = dn, v = dv;
+        return true;
+    };
+    for (bool first = true; f != l; first = false) {
+        const auto b = static_cast<uint8_t>(*f);
+        std::string_view n, v;
+        uint32_t i;
+        if (b & 0x80) { // indexed field
+            if (!read_int(f, l, 7, i) || !entry(i, n, v)) return error_code::compression_error;
+        } else if ((b & 0xe0) == 0x20) { // dynamic table size update, only at the start
+            if (!first || !read_int(f, l, 5, i) || i > maxsize)
+                return error_code::compression_error;
+            evict(cap_ = i);
+            continue;
+        } else { // literal field: with incremental indexing, without, or never indexed
+            const auto prefix = b & 0x40 ? 6 : 4;
+            if (!read_int(f, l, prefix, i)) return error_code::compression_error;
+            if (i) {
+                if (std::string_view _; !entry(i, n, _)) return error_code::compression_error;
+                if (i > static_size) n = nbuf = n; // the insert below may evict its entry
+            } else if (!read_str(f, l, nbuf, n)) {
+                return error_code::compression_error;
+            }
+            if (!read_str(f, l, vbuf, v)) return error_code::compression_error;
+            if (b & 0x40) {
+                if (n.data() != nbuf.data()) n = nbuf = n;
+                insert(n, v);
+            }
+        }
+        if (err != error_code::no_error) continue;
+        if ((nlist += n.size() + v.size() + 32) > max) {
+            err = error_code::enhance_your_calm;
+            continue;
+        }
+        if (!is_valid(n, v)) {
+            err = error_code::protocol_error;
+            continue;
+        }
+        out.append(n).append(": ").append(v).append("\r\n");
+    }
+    return err;
+}
+
+//
+// encoder
+//
+
+std::size_t encode_head(const std::string_view head, std::string &out)
+{
+    const auto eoh = head.find("\r\n\r\n");
+    CHECK(eoh, != std::string_view::npos);
+
+    // status line, e.g. "HTTP/1.1 200 OK"
+    auto eol = head.find("\r\n");
+    const auto status = head.substr(9, 3);
+    if (const auto it =
+            std::ranges::find_if(static_table, L(x.name == ":status" && x.value == status, &));
+        it != std::end(static_table)) {
+        write_int(out, 7, 0x80, static_cast<uint32_t>(it - std::begin(static_table) + 1));
+    } else {
+        write_int(out, 4, 0, 8); // literal without indexing, named ":status"
+        write_str(out, status);
+    }
+
+    // other fields, left out of the dynamic table (literal without indexing)
+    std::string name;
+    for (std::size_t f = eol + 2; f < eoh + 2; f = eol + 2) {
+        eol             = head.find("\r\n", f);
+        const auto line = head.substr(f, eol - f);
+        const auto col  = line.find(':');
+        name.assign(line.substr(0, col));
+        std::ranges::transform(name, name.begin(), L(x >= 'A' && x <= 'Z' ? x + 32 : x));
+        if (name == "connection" || name == "keep-alive" || name == "transfer-encoding" ||
+            name == "upgrade" || name == "proxy-connection")
+            continue;
+        auto value = line.substr(col + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        if (const auto it = std::ranges::find(static_table, name, &static_entry::name);
+            it != std::end(static_table)) {
+            write_int(out, 4, 0, static_cast<uint32_t>(it - std::begin(static_table) + 1));
+        } else {
+            out += '\0';
+            write_str(out, name);
+        }
+        write_str(out, value);
+    }
+    return eoh + 4;
+}
+} // namespace h2
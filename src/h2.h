@@ -0,0 +1,146 @@
+#pragma once
+
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+
+#include "jutil.h"
+
+//! @brief HTTP/2 framing (RFC 7540) and header compression (RFC 7541)
+//!
+//! Requests are decoded to, and responses encoded from, the HTTP/1.1 form the rest of the server
+//! speaks, so that the same parsing and serving apply to the streams of an HTTP/2 connection.
+namespace h2
+{
+constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+//
+// FRAMES
+//
+
+enum class frame_type : uint8_t {
+    data,
+    headers,
+    priority,
+    rst_stream,
+    settings,
+    push_promise,
+    ping,
+    goaway,
+    window_update,
+    continuation
+};
+
+namespace flag
+{
+constexpr uint8_t end_stream = 0x1, ack = 0x1, end_headers = 0x4, padded = 0x8, priority = 0x20;
+} // namespace flag
+
+enum class error_code : uint32_t {
+    no_error,
+    protocol_error,
+    internal_error,
+    flow_control_error,
+    settings_timeout,
+    stream_closed,
+    frame_size_error,
+    refused_stream,
+    cancel,
+    compression_error,
+    connect_error,
+    enhance_your_calm,
+    inadequate_security,
+    http_1_1_required
+};
+
+enum class setting : uint16_t {
+    header_table_size = 1,
+    enable_push,
+    max_concurrent_streams,
+    initial_window_size,
+    max_frame_size,
+    max_header_list_size
+};
+
+constexpr std::size_t frame_header_size  = 9;
+constexpr std::size_t default_frame_size = 16384; // SETTINGS_MAX_FRAME_SIZE until told otherwise
+constexpr uint32_t default_window        = 65535; // SETTINGS_INITIAL_WINDOW_SIZE likewise
+constexpr uint32_t max_window            = 0x7fffffff;
+
+struct frame_header {
+    uint32_t length;
+    frame_type type;
+    uint8_t flags;
+    uint32_t sid; // stream identifier; 0 for the connection
+
+    //! @brief Reads a frame header from the frame_header_size bytes at p
+    [[nodiscard]] static JUTIL_INLINE frame_header read(const char *const p) noexcept
+    {
+        const auto b = reinterpret_cast<const uint8_t *>(p);
+        return {.length = uint32_t{b[0]} << 16 | uint32_t{b[1]} << 8 | b[2],
+                .type   = static_cast<frame_type>(b[3]),
+                .flags  = b[4],
+                .sid    = read_u32(p + 5) & max_window};
+    }
+    //! @brief Writes the frame header to the frame_header_size bytes at p
+    //! @return Pointer past the frame header
+    JUTIL_INLINE char *write(char *const p) const noexcept
+    {
+        p[0] = static_cast<char>(length >> 16);
+        p[1] = static_cast<char>(length >> 8);
+        p[2] = static_cast<char>(length);
+        p[3] = static_cast<char>(type);
+        p[4] = static_cast<char>(flags);
+        return write_u32(p + 5, sid);
+    }
+
+    [[nodiscard]] static JUTIL_INLINE uint32_t read_u32(const char *const p) noexcept
+    {
+        const auto b = reinterpret_cast<const uint8_t *>(p);
+        return uint32_t{b[0]} << 24 | uint32_t{b[1]} << 16 | uint32_t{b[2]} << 8 | b[3];
+    }
+    static JUTIL_INLINE char *write_u32(char *const p, const uint32_t x) noexcept
+    {
+        p[0] = static_cast<char>(x >> 24);
+        p[1] = static_cast<char>(x >> 16);
+        p[2] = static_cast<char>(x >> 8);
+        p[3] = static_cast<char>(x);
+        return p + 4;
+    }
+};
+
+//
+// HPACK
+//
+
+//! @brief Decodes header blocks, keeping the dynamic table they build up across blocks
+struct decoder {
+    static constexpr std::size_t maxsize = 4096; // SETTINGS_HEADER_TABLE_SIZE, left at default
+
+    //! @brief Decodes a header block into header lines ("name: value\r\n"), appended to out
+    //! @param max The largest header list taken, sized as SETTINGS_MAX_HEADER_LIST_SIZE has it
+    //!        (name, value and 32 bytes a field); past it, the rest of the block is decoded only
+    //!        for the dynamic table to stay in sync, so that a small block referring to a large
+    //!        entry over and over can't have out grow without bound
+    //! @return no_error; compression_error if the block can't be decoded, which leaves the
+    //!         connection unusable; protocol_error if a field can't be given in HTTP/1.1 form
+    //!         (e.g., has a CR or an uppercase name), or enhance_your_calm if the list was larger
+    //!         than max, either of which only fails the stream
+    error_code decode(std::string_view block, std::string &out, std::size_t max);
+
+  private:
+    std::deque<std::pair<std::string, std::string>> dyn_; // newest first
+    std::size_t size_ = 0, cap_ = maxsize;
+
+    void insert(std::string_view name, std::string_view value);
+    void evict(std::size_t cap) noexcept;
+};
+
+//! @brief Encodes a response header in HTTP/1.1 form (up to its CRLFCRLF) as a header block
+//! @param head The response header, possibly followed by (the start of) its body
+//! @param out Where the header block is appended to
+//! @return How much of head the header spans, i.e., where the body begins
+//! @note Fields specific to HTTP/1.1 connections (e.g., connection, transfer-encoding) are left out
+std::size_t encode_head(std::string_view head, std::string &out);
+} // namespace h2
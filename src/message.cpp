@@ -1,5 +1,7 @@
 #include "message.h"
 
+#include <bit>
+#include <immintrin.h>
 #include <magic_enum.hpp>
 #include <string.h>
 
@@ -20,16 +22,106 @@ void headers::grow()
 
 void headers::reserve(char *const kf, char *const kl, char *const vf, char *const vl)
 {
+    const string k{kf, static_cast<std::size_t>(kl - kf)}, v{vf, static_cast<std::size_t>(vl - vf)};
+    if (const auto f = find_field(k); f != field::none && !has(f)) [[likely]] {
+        slots_[std::to_underlying(f)] = v;
+        has_ |= 1u << std::to_underlying(f);
+        return;
+    }
     if (n_ == cap_) [[unlikely]]
         grow();
-    const auto f = begin();
-    const auto l = end();
-    l->first.n   = 0;
-    const string k{kf, static_cast<std::size_t>(kl - kf)};
-    const auto lb = find_if_always_idx(f, l + 1, L(!(k < x.first), k));
-    memmove(&f[lb + 1], &f[lb], sizeof(entry) * (n_ - lb));
-    ++n_;
-    f[lb] = {k, {vf, static_cast<std::size_t>(vl - vf)}};
+    buf_[n_++] = {k, v};
+}
+
+//
+// byte vectors
+//
+
+namespace
+{
+//! @brief The widest byte vectors at hand, and the operations the parsing below needs of them
+struct bytevec {
+#ifdef __AVX2__
+    using type                         = __m256i;
+    static constexpr std::size_t width = 32;
+
+    static JUTIL_INLINE type load(const char *const p) noexcept
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const type *>(p));
+    }
+    static JUTIL_INLINE void store(char *const p, const type v) noexcept
+    {
+        _mm256_storeu_si256(reinterpret_cast<type *>(p), v);
+    }
+    //! @return Mask of the bytes of v that equal c
+    static JUTIL_INLINE uint32_t eq(const type v, const char c) noexcept
+    {
+        const auto m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+    }
+    //! @return v with its first n bytes lowercased
+    static JUTIL_INLINE type lower_prefix(const type v, const unsigned n) noexcept
+    {
+        const auto iota = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, //
+                                           16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                           30, 31);
+        const auto up   = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+        const auto in   = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(n)), iota);
+        const auto d    = _mm256_and_si256(_mm256_and_si256(up, in), _mm256_set1_epi8(0x20));
+        return _mm256_add_epi8(v, d);
+    }
+#else
+    using type                         = __m128i;
+    static constexpr std::size_t width = 16;
+
+    static JUTIL_INLINE type load(const char *const p) noexcept
+    {
+        return _mm_loadu_si128(reinterpret_cast<const type *>(p));
+    }
+    static JUTIL_INLINE void store(char *const p, const type v) noexcept
+    {
+        _mm_storeu_si128(reinterpret_cast<type *>(p), v);
+    }
+    static JUTIL_INLINE uint32_t eq(const type v, const char c) noexcept
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+    }
+    static JUTIL_INLINE type lower_prefix(const type v, const unsigned n) noexcept
+    {
+        const auto iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        const auto up   = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+        const auto in   = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(n)), iota);
+        return _mm_add_epi8(v, _mm_and_si128(_mm_and_si128(up, in), _mm_set1_epi8(0x20)));
+    }
+#endif
+    //! @return Whether a vector can be loaded at f without going past l
+    static JUTIL_INLINE bool fits(const char *const f, const char *const l) noexcept
+    {
+        return l - f >= static_cast<std::ptrdiff_t>(width);
+    }
+};
+} // namespace
+
+//
+// find_crlf2
+//
+
+// Candidates are the positions with CR at 0 and LF at 3, which within a header seldom aren't a
+// CRLFCRLF; the two bytes in between are checked for each.
+char *find_crlf2(char *f, char *const l) noexcept
+{
+    for (; static_cast<std::size_t>(l - f) >= bytevec::width + 3; f += bytevec::width) {
+        const auto m0 = bytevec::eq(bytevec::load(f), '\r');
+        for (auto m = m0 & bytevec::eq(bytevec::load(f + 3), '\n'); m; m &= m - 1) {
+            const auto p = f + std::countr_zero(m);
+            if (p[1] == '\n' && p[2] == '\r') return p;
+        }
+    }
+    for (; l - f >= 4; ++f)
+        if (memcmp(f, "\r\n\r\n", 4) == 0) return f;
+    return l;
 }
 
 //
@@ -37,17 +129,49 @@ void headers::reserve(char *const kf, char *const kl, char *const vf, char *cons
 //
 
 constexpr auto lccnv = L(to_unsigned(x - 'A') <= to_unsigned('Z' - 'A') ? x + ('a' - 'A') : x);
+
+namespace
+{
+//! @brief Lowercases a field name in place, a vector at a time while they fit before e
+//! @return Pointer to the colon ending the name
+JUTIL_INLINE char *lower_name(char *f, char *const e, char *const l) noexcept
+{
+    for (; bytevec::fits(f, e); f += bytevec::width) {
+        const auto v = bytevec::load(f);
+        const auto m = bytevec::eq(v, ':');
+        const auto n = m ? static_cast<unsigned>(std::countr_zero(m)) : unsigned{bytevec::width};
+        bytevec::store(f, bytevec::lower_prefix(v, n));
+        if (m) return f + n;
+    }
+    return transform_always_until(f, l, f, L(static_cast<char>(lccnv(x))), ':');
+}
+
+//! @brief Finds the CR ending a line, a vector at a time while they fit before e
+JUTIL_INLINE char *find_cr(char *f, char *const e, char *const l) noexcept
+{
+    for (; bytevec::fits(f, e); f += bytevec::width)
+        if (const auto m = bytevec::eq(bytevec::load(f), '\r')) return f + std::countr_zero(m);
+    return find_always(f, l, '\r');
+}
+} // namespace
+
+// Each line is scanned for its CR a vector at a time, and its field name lowercased likewise up to
+// the colon, unless the line is shorter than a vector: the name is then lowercased a byte at a
+// time, which costs less than setting up a vector for it. Vectors are only loaded within the
+// header, up to the end of its CRLFCRLF, with the rest of a line handled a byte at a time.
 void parse_header(char *f, char *const l, message &msg)
 {
-    auto i = std::find(f, l, '\r');
+    const auto e = l + 4;
+    auto i       = find_cr(f, e, l);
     parse_start(f, i, msg.strt);
     msg.hdrs.clear();
     l[1] = ':'; // sentinel
     while (reinterpret_cast<uintptr_t>(i) < reinterpret_cast<uintptr_t>(l)) {
         f                = i + 2;
-        const auto colon = transform_always_until(f, l + 2, f, L(static_cast<char>(lccnv(x))), ':');
+        const auto eol   = find_cr(f, e, l + 3);
+        const auto colon = lower_name(f, bytevec::fits(f, eol) ? e : f, l + 2);
         const auto val   = find_if_always(colon + 1, l + 2, L(!(phdrws(x))));
-        i                = find_always(val, l + 3, '\r');
+        i                = colon < eol ? eol : find_cr(val, e, l + 3); // past a line lacking one
         msg.hdrs.reserve(f, colon, val, i);
     }
 }
@@ -56,6 +180,85 @@ void parse_header(std::span<char> str, message &msg)
     parse_header(str.data(), str.data() + str.size(), msg);
 }
 
+//
+// chunked_decoder
+//
+
+constexpr auto hexval = [](const char c) noexcept {
+    if (to_unsigned(c - '0') <= 9) return c - '0';
+    if (to_unsigned((c | 0x20) - 'a') <= 'f' - 'a') return (c | 0x20) - 'a' + 10;
+    return -1;
+};
+
+std::string_view chunked_decoder::next(const char *&f, const char *const l) noexcept
+{
+    using enum state;
+    const auto fail = [&] { return st = bad, std::string_view{}; };
+    for (; f != l; ++f) {
+        const auto c = *f;
+        switch (st) {
+        case size:
+            if (const auto d = hexval(c); d != -1) {
+                if (left >> 60) return fail(); // would overflow
+                left   = left << 4 | static_cast<std::size_t>(d);
+                digits = true;
+            } else if (!digits)
+                return fail();
+            else if (c == '\r')
+                st = size_lf;
+            else if (c == ';')
+                st = ext;
+            else
+                return fail();
+            break;
+        case ext:
+            if (c == '\r') st = size_lf;
+            else if (c == '\n') return fail();
+            break;
+        case size_lf:
+            if (c != '\n') return fail();
+            st     = left ? data : trailer;
+            digits = false;
+            break;
+        case data: {
+            const auto n = std::min(left, static_cast<std::size_t>(l - f));
+            const std::string_view res{f, n};
+            f += n;
+            if (!(left -= n)) st = data_cr;
+            return res;
+        }
+        case data_cr:
+            if (c != '\r') return fail();
+            st = data_lf;
+            break;
+        case data_lf:
+            if (c != '\n') return fail();
+            st = size;
+            break;
+        case trailer:
+            if (c == '\n') return fail();
+            st = c == '\r' ? end_lf : field;
+            break;
+        case field:
+            if (c == '\n') return fail();
+            if (c == '\r') st = field_lf;
+            break;
+        case field_lf:
+            if (c != '\n') return fail();
+            st = trailer;
+            break;
+        case end_lf:
+            if (c != '\n') return fail();
+            ++f;
+            st = done;
+            return {};
+        case done:
+        case bad: return {};
+        }
+    }
+    return {};
+}
+
 //
 // print_header
 //
@@ -67,6 +270,12 @@ void print_header(const message &msg)
     printf("METHOD: %.*s\nTARGET: %.*s\nVERSION: %.*s\n", static_cast<int>(mtds.size()),
            mtds.data(), static_cast<int>(msg.strt.tgt.n), msg.strt.tgt.p,
            static_cast<int>(ver.size()), ver.data());
+    for (std::size_t i = 0; i < std::size(field_names); ++i) {
+        const auto a = field_names[i], b = msg.hdrs.get(static_cast<field>(i), {});
+        if (b.data())
+            printf("  %.*s: %.*s\n", static_cast<int>(a.size()), a.data(),
+                   static_cast<int>(b.size()), b.data());
+    }
     for (const auto [a, b] : msg.hdrs)
         printf("  %.*s: %.*s\n", static_cast<int>(a.n), a.p, static_cast<int>(b.n), b.p);
 }
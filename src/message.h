@@ -1,9 +1,11 @@
 #pragma once
 
+#include <array>
 #include <limits>
 #include <memory>
 #include <stdexcept>
 #include <string_view>
+#include <utility>
 
 #include "jutil.h"
 
@@ -56,10 +58,100 @@ struct start {
 
 void parse_start(char *const f, char *const l, start &s) noexcept;
 
+//
+// FIELDS
+//
+
+//! @brief Well-known request fields, each of which headers keeps in a slot of its own
+enum class field : uint8_t {
+    accept,
+    accept_encoding,
+    accept_language,
+    authorization,
+    cache_control,
+    connection,
+    content_length,
+    content_type,
+    cookie,
+    expect,
+    host,
+    if_modified_since,
+    if_none_match,
+    if_range,
+    keep_alive,
+    origin,
+    range,
+    referer,
+    te,
+    transfer_encoding,
+    upgrade,
+    user_agent,
+    none
+};
+constexpr std::string_view field_names[]{
+    "accept", "accept-encoding", "accept-language", "authorization", "cache-control", "connection",
+    "content-length", "content-type", "cookie", "expect", "host", "if-modified-since",
+    "if-none-match", "if-range", "keep-alive", "origin", "range", "referer", "te",
+    "transfer-encoding", "upgrade", "user-agent"};
+static_assert(std::size(field_names) == std::to_underlying(field::none));
+
+// A field name is keyed by its length and its first, middle and last characters, and the key
+// hashed multiplicatively into a table twice the size of field_names or so; the multiplier is
+// searched for at compile time such that no two names share a slot of the table.
+namespace field_hash
+{
+constexpr std::size_t bits = 6, minlen = 2, maxlen = 17;
+
+constexpr JUTIL_INLINE uint32_t key(const char *const p, const std::size_t n) noexcept
+{
+    const auto c = [](const char x) -> uint32_t { return static_cast<unsigned char>(x); };
+    return static_cast<uint32_t>(n) | c(p[0]) << 8 | c(p[n - 1]) << 16 | c(p[n / 2]) << 24;
+}
+constexpr JUTIL_INLINE std::size_t slot(const uint32_t k, const uint32_t seed) noexcept
+{
+    return (k * seed) >> (32 - bits);
+}
+constexpr uint32_t seed = [] {
+    const auto perfect = [](const uint32_t s) {
+        uint64_t used = 0;
+        for (const auto nm : field_names)
+            if (const auto b = 1ull << slot(key(nm.data(), nm.size()), s); used & b) return false;
+            else used |= b;
+        return true;
+    };
+    for (uint32_t s = 1; s < (1u << 16); s += 2)
+        if (perfect(s)) return s;
+    return 0u;
+}();
+static_assert(seed, "no seed hashes field_names perfectly; widen the key or the table");
+constexpr auto table = [] {
+    std::array<field, 1uz << bits> t;
+    t.fill(field::none);
+    for (std::size_t i = 0; i < std::size(field_names); ++i)
+        t[slot(key(field_names[i].data(), field_names[i].size()), seed)] = static_cast<field>(i);
+    return t;
+}();
+} // namespace field_hash
+
+//! @brief Finds the well-known field of given lowercase name
+//! @return The field, or field::none for any other name
+[[nodiscard]] constexpr JUTIL_INLINE field find_field(const std::string_view lc) noexcept
+{
+    using namespace field_hash;
+    if (lc.size() - minlen > maxlen - minlen) return field::none;
+    const auto f = table[slot(key(lc.data(), lc.size()), seed)];
+    return f != field::none && field_names[std::to_underlying(f)] == lc ? f : field::none;
+}
+
 //
 // HEADERS
 //
 
+//! @brief The header fields of a message
+//!
+//! Well-known fields go into slots indexed by their field, which get(field) reads directly;
+//! other fields, along with repeats of well-known ones, go into an overflow list in the order they
+//! appear in, which begin() and end() span.
 struct headers {
     struct entry {
         string first, second;
@@ -77,21 +169,40 @@ struct headers {
     //
     // MODIFICATION
     //
-    constexpr JUTIL_INLINE void clear() noexcept { n_ = 0; }
+    constexpr JUTIL_INLINE void clear() noexcept { n_ = 0, has_ = 0; }
     void grow();
     void reserve(char *const kf, char *const kl, char *const vf, char *const vl);
 
+    //
+    // FIELD GET
+    //
+    [[nodiscard]] JUTIL_INLINE bool has(const field f) const noexcept
+    {
+        return has_ >> std::to_underlying(f) & 1;
+    }
+    [[nodiscard]] JUTIL_INLINE std::string_view get(const field f) const
+    {
+        return has(f) ? slots_[std::to_underlying(f)] : throw std::out_of_range{"headers::get"};
+    }
+    [[nodiscard]] JUTIL_INLINE std::string_view get(const field f,
+                                                    const std::string_view def) const noexcept
+    {
+        return has(f) ? slots_[std::to_underlying(f)] : def;
+    }
+
     //
     // KEY GET
     //
     [[nodiscard]] JUTIL_INLINE std::string_view get(const std::string_view keyuc) const
     {
+        if (const auto f = find_field(keyuc); f != field::none) return get(f);
         const auto it = sr::find(begin(), end(), keyuc, L(std::string_view(x.first.p, x.first.n)));
         return (it == end()) ? throw std::out_of_range{"headers::get"} : it->second;
     }
     [[nodiscard]] JUTIL_INLINE std::string_view get(const std::string_view keyuc,
                                                     const std::string_view def) const noexcept
     {
+        if (const auto f = find_field(keyuc); f != field::none) return get(f, def);
         const auto it = sr::find(begin(), end(), keyuc, L(std::string_view(x.first.p, x.first.n)));
         return (it == end()) ? def : it->second;
     }
@@ -100,7 +211,7 @@ struct headers {
     {
         char uc[N - 1];
         std::transform(key, key + (N - 1), uc, FREF(tolower));
-        return get(std::string_view{uc});
+        return get(std::string_view{uc, N - 1});
     }
     template <std::size_t N>
     [[nodiscard]] JUTIL_INLINE std::string_view get(const char (&key)[N],
@@ -108,9 +219,12 @@ struct headers {
     {
         char uc[N - 1];
         std::transform(key, key + (N - 1), uc, FREF(tolower));
-        return get(std::string_view{uc}, def);
+        return get(std::string_view{uc, N - 1}, def);
     }
 
+    string slots_[std::to_underlying(field::none)];
+    uint32_t has_ = 0; // bit per field of slots_ set
+    static_assert(std::size(field_names) <= 32);
     std::unique_ptr<entry[]> buf_ = std::make_unique_for_overwrite<entry[]>(defcap);
     std::size_t n_ = 0uz, cap_ = defcap;
 };
@@ -122,6 +236,50 @@ struct headers {
 void parse_header(char *f, char *const l, struct message &msg);
 void print_header(const struct message &msg);
 
+//! @brief Finds the end of a message header, i.e., the first CRLFCRLF in [f:l)
+//! @return Pointer to the CRLFCRLF, or l if there's none
+//! @note When scanning data as it arrives, the next scan can begin 3 bytes before the end of the
+//!       data that's been scanned, as no CRLFCRLF begins before that
+[[nodiscard]] char *find_crlf2(char *f, char *l) noexcept;
+
+//
+// CHUNKED
+//
+
+//! @brief Decodes a body in chunked transfer coding (RFC 7230 section 4.1) as it arrives
+//!
+//! Data isn't copied anywhere, but handed out as spans of the input; chunk extensions and trailer
+//! fields are skipped. Line ends must be CRLF, as a bare CR or LF taken differently by a proxy in
+//! front would let requests be smuggled past it.
+struct chunked_decoder {
+    enum class state : uint8_t {
+        size,     // in a chunk size
+        ext,      // in chunk extensions, after the size
+        size_lf,  // at the LF ending the chunk size line
+        data,     // in the data of a chunk
+        data_cr,  // at the CRLF ending the data
+        data_lf,  //
+        trailer,  // at the start of a trailer field, or the CRLF ending the body
+        field,    // in a trailer field
+        field_lf, // at the LF ending it
+        end_lf,   // at the LF ending the body
+        done,
+        bad
+    };
+
+    state st         = state::size;
+    bool digits      = false; // the chunk size being parsed has some
+    std::size_t left = 0;     // of the chunk being decoded (or its size, as it's being parsed)
+
+    //! @brief Decodes [f:l) up to the end of the first span of data in it
+    //! @param f Where to decode from; advanced past what's been decoded
+    //! @return The span of data; empty if there's none before l, or the body has ended
+    std::string_view next(const char *&f, const char *l) noexcept;
+
+    [[nodiscard]] JUTIL_INLINE bool done() const noexcept { return st == state::done; }
+    [[nodiscard]] JUTIL_INLINE bool bad() const noexcept { return st == state::bad; }
+};
+
 //
 // MESSAGE
 //
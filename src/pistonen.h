@@ -1,11 +1,37 @@
 #pragma once
 
+#include "detail/generator.h"
+#include "detail/handshake.h"
 #include "detail/server.h"
+#include "detail/subtask.h"
 
 namespace pnen
 {
+using detail::alpn_transport;
+using detail::connect_mem;
+using detail::corking_transport;
+using detail::file_transport;
+using detail::generator;
+using detail::handshake;
+using detail::handshake_transport;
+using detail::io_backend;
+using detail::mem_alpn_transport;
+using detail::mem_pipe;
+using detail::mem_transport;
+using detail::offload;
+using detail::offload_pool;
 using detail::run_server;
 using detail::run_server_options;
+using detail::sleep_for;
 using detail::socket;
+using detail::subtask;
 using detail::task;
+using detail::tcp_transport;
+using detail::tls_transport;
+using detail::transport;
+using detail::when_all;
+using detail::when_any;
+#ifdef PNEN_IO_URING
+using detail::uring_transport;
+#endif
 } // namespace pnen 
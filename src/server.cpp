@@ -1,9 +1,15 @@
 ﻿#include "server.h"
 
+#include <atomic>
 #include <charconv>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <range/v3/algorithm/copy.hpp>
@@ -12,9 +18,15 @@
 #include <robin_hood.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
 
 #include "buffer.h"
 #include "format.h"
+#include "h2.h"
 #include "jutil.h"
 #include "message.h"
 #include "pistonen.h"
@@ -24,6 +36,16 @@
 #include "lmacro_begin.h"
 
 #define KEEP_ALIVE_SECS 3
+#define KEEP_ALIVE_MAX  100 // requests served per connection
+#define SENDFILE_MIN    (16 * 1024) // smaller files are cheaper to copy along with the header
+#define STREAM_CHUNK    (64 * 1024) // larger files are read as they're sent, this much at a time
+#define BODY_BUFFER_MAX (64 * 1024) // larger request bodies aren't taken by routes that buffer them
+#define BODY_READ_CHUNK (64 * 1024) // the rest of a request body is read this much at a time
+#define LINGER_MAX      (1024 * 1024) // request bytes read past before closing (see linger())
+#define H2_MAX_STREAMS  100 // concurrent streams an HTTP/2 client may open
+#define H2_MAX_BLOCK    (64 * 1024) // request header blocks beyond this fail the connection
+#define H2_MAX_LIST     (64 * 1024) // decoded request header size, as SETTINGS_MAX_HEADER_LIST_SIZE
+#define H2_WRITE_MAX    (256 * 1024) // response bytes gathered into one write
 
 namespace sc = std::chrono;
 namespace sf = std::filesystem;
@@ -59,6 +81,380 @@ void log_ssl_error(SSL *ssl, const char *fname, int err, std::source_location sl
         },
         nullptr);
 }
+
+bool pin_to_cpu(const unsigned i) noexcept
+{
+    cpu_set_t cs;
+    if (sched_getaffinity(0, sizeof(cs), &cs) == -1) return false;
+    const auto ncpu = static_cast<unsigned>(CPU_COUNT(&cs));
+    if (!ncpu) return false;
+    auto cpu = 0u;
+    for (auto n = i % ncpu;; ++cpu)
+        if (CPU_ISSET(cpu, &cs) && !n--) break;
+    CPU_ZERO(&cs);
+    CPU_SET(cpu, &cs);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cs), &cs) == 0;
+}
+
+//
+// frame_pool
+//
+
+namespace
+{
+//! @brief A statistic written by its owning thread only, but readable by any
+struct counter {
+    std::atomic<uint64_t> v = 0;
+    JUTIL_INLINE void add(const int64_t d) noexcept
+    {
+        v.store(v.load(std::memory_order_relaxed) + static_cast<uint64_t>(d),
+                std::memory_order_relaxed);
+    }
+    [[nodiscard]] JUTIL_INLINE uint64_t get() const noexcept
+    {
+        return v.load(std::memory_order_relaxed);
+    }
+};
+
+struct frame_slab;
+std::mutex g_slabs_mtx;
+std::vector<const frame_slab *> g_slabs; // of live threads
+frame_pool::stats g_retired_slabs{};     // of exited threads
+
+struct frame_slab {
+    static constexpr std::size_t slabsz = 64 * 1024;
+
+    struct bin {
+        std::size_t n;
+        void *free = nullptr; // intrusive list: a free block starts with the next one's address
+    };
+    std::vector<bin> bins; // one per frame size; there are only a handful
+    std::vector<std::unique_ptr<std::byte[]>> slabs;
+    counter hits, misses, live, cached, live_bytes, slab_bytes;
+
+    frame_slab()
+    {
+        std::scoped_lock lk{g_slabs_mtx};
+        g_slabs.push_back(this);
+    }
+    ~frame_slab()
+    {
+        std::scoped_lock lk{g_slabs_mtx};
+        std::erase(g_slabs, this);
+        g_retired_slabs.hits += hits.get();
+        g_retired_slabs.misses += misses.get();
+    }
+
+    [[nodiscard]] JUTIL_INLINE bin &get_bin(const std::size_t n)
+    {
+        const auto it = sr::find(bins, n, &bin::n);
+        return it != bins.end() ? *it : bins.emplace_back(n);
+    }
+
+    [[nodiscard]] void *allocate(const std::size_t n)
+    {
+        auto &b = get_bin(n);
+        live.add(1);
+        live_bytes.add(static_cast<int64_t>(n));
+        if (b.free) [[likely]] {
+            hits.add(1);
+            cached.add(-1);
+            return std::exchange(b.free, *static_cast<void **>(b.free));
+        }
+        // carve a new slab: hand out its first block, put the rest on the free list
+        misses.add(1);
+        const auto bsz = std::max(n, sizeof(void *));
+        const auto nb  = std::max(slabsz / bsz, std::size_t{1});
+        const auto p =
+            slabs.emplace_back(std::make_unique_for_overwrite<std::byte[]>(bsz * nb)).get();
+        for (auto i = nb; --i;)
+            *reinterpret_cast<void **>(p + i * bsz) = std::exchange(b.free, p + i * bsz);
+        cached.add(static_cast<int64_t>(nb - 1));
+        slab_bytes.add(static_cast<int64_t>(bsz * nb));
+        return p;
+    }
+
+    JUTIL_INLINE void deallocate(void *const p, const std::size_t n) noexcept
+    {
+        auto &b                  = *sr::find(bins, n, &bin::n);
+        *static_cast<void **>(p) = std::exchange(b.free, p);
+        live.add(-1);
+        live_bytes.add(-static_cast<int64_t>(n));
+        cached.add(1);
+    }
+};
+thread_local frame_slab t_slab;
+} // namespace
+
+void *frame_pool::allocate(const std::size_t n) { return t_slab.allocate(n); }
+void frame_pool::deallocate(void *const p, const std::size_t n) noexcept
+{
+    t_slab.deallocate(p, n);
+}
+
+frame_pool::stats frame_pool::totals() noexcept
+{
+    std::scoped_lock lk{g_slabs_mtx};
+    auto res = g_retired_slabs;
+    for (const auto s : g_slabs) {
+        res.hits += s->hits.get();
+        res.misses += s->misses.get();
+        res.live += s->live.get();
+        res.cached += s->cached.get();
+        res.live_bytes += s->live_bytes.get();
+        res.slab_bytes += s->slab_bytes.get();
+    }
+    return res;
+}
+
+//
+// offload
+//
+
+namespace
+{
+struct pool_state {
+    std::mutex mtx;
+    std::condition_variable_any cv;
+    std::deque<offload_job *> q;
+    std::vector<std::jthread> ts;
+    std::atomic<uint64_t> jobs = 0, wait_us = 0, run_us = 0;
+};
+pool_state g_pools[noffload_pools];
+thread_local offload_port *t_port = nullptr;
+
+[[nodiscard]] JUTIL_INLINE pool_state &pool_of(const offload_pool p) noexcept
+{
+    return g_pools[std::to_underlying(p)];
+}
+
+void offload_worker(const std::stop_token st, pool_state &ps)
+{
+    for (;;) {
+        offload_job *j;
+        {
+            std::unique_lock lk{ps.mtx};
+            if (!ps.cv.wait(lk, st, L0(!ps.q.empty(), &))) return;
+            j = ps.q.front();
+            ps.q.pop_front();
+        }
+        if (auto s = uint8_t{offload_job::queued};
+            j->st.compare_exchange_strong(s, offload_job::running)) {
+            const auto t0 = mono_ns();
+            j->run();
+            const auto t1 = mono_ns();
+            ps.jobs.fetch_add(1, std::memory_order_relaxed);
+            ps.wait_us.fetch_add((t0 - j->posted) / 1000, std::memory_order_relaxed);
+            ps.run_us.fetch_add((t1 - t0) / 1000, std::memory_order_relaxed);
+            j->st.store(offload_job::done);
+            j->st.notify_one();
+        }
+        j->port->complete(*j);
+    }
+}
+} // namespace
+
+void offload_start(const offload_pool pool, const unsigned nthreads)
+{
+    auto &ps = pool_of(pool);
+    ps.ts.reserve(nthreads);
+    for (unsigned i = 0; i < nthreads; ++i)
+        ps.ts.emplace_back(offload_worker, std::ref(ps));
+}
+
+void offload_post(offload_job &j) noexcept
+{
+    auto &ps = pool_of(j.pool);
+    j.posted = mono_ns();
+    {
+        std::scoped_lock lk{ps.mtx};
+        ps.q.push_back(&j);
+    }
+    ps.cv.notify_one();
+}
+
+void offload_release(offload_job *const j) noexcept
+{
+    if (!j->port || j->delivered) return delete j;
+    // the job is queued, running or done; stop it from running, or wait until it no longer is
+    if (auto s = uint8_t{offload_job::queued};
+        !j->st.compare_exchange_strong(s, offload_job::cancelled)) {
+        for (; s == offload_job::running; s = j->st.load())
+            j->st.wait(s);
+    }
+    j->h = {}; // the port disposes of it
+}
+
+offload_port::offload_port() : efd{CHECK(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), != -1)}
+{
+    t_port = this;
+}
+
+offload_port::~offload_port()
+{
+    if (t_port == this) t_port = nullptr;
+    CHECK(close(efd), != -1);
+}
+
+offload_port *offload_port::current(const offload_pool pool) noexcept
+{
+    return pool_of(pool).ts.empty() ? nullptr : t_port;
+}
+
+offload_stats offload_totals(const offload_pool pool) noexcept
+{
+    auto &ps = pool_of(pool);
+    std::size_t queued;
+    {
+        std::scoped_lock lk{ps.mtx};
+        queued = ps.q.size();
+    }
+    return {.queued  = queued,
+            .jobs    = ps.jobs.load(std::memory_order_relaxed),
+            .wait_us = ps.wait_us.load(std::memory_order_relaxed),
+            .run_us  = ps.run_us.load(std::memory_order_relaxed)};
+}
+
+void offload_port::complete(offload_job &j) noexcept
+{
+    bool first;
+    {
+        std::scoped_lock lk{mtx};
+        first = done.empty();
+        done.push_back(&j);
+    }
+    // otherwise, the reactor has yet to drain the jobs whose arrival has already been signalled
+    if (first) {
+        const uint64_t one = 1;
+        CHECK(write(efd, &one, sizeof(one)), == sizeof(one));
+    }
+}
+
+//
+// tls
+//
+
+namespace
+{
+std::atomic<uint64_t> g_handshakes = 0, g_resumed = 0, g_handshake_us = 0;
+
+constexpr std::size_t nticket_keys = 4; // as many as a libtls config keeps
+
+//! @brief A ticket key as stored in the key file, which is an array of them, oldest first
+struct ticket_key {
+    uint32_t rev;
+    unsigned char key[TLS_TICKET_KEY_SIZE];
+};
+
+struct ticket_store {
+    std::mutex mtx;
+    std::vector<ticket_key> keys;     // oldest first, at most nticket_keys
+    std::atomic<uint32_t> newest = 0; // rev of keys.back()
+    uint32_t period              = 0; // s between keys; 0 = no tickets
+    const char *file             = nullptr;
+} g_tickets;
+
+[[nodiscard]] JUTIL_INLINE uint32_t due_rev() noexcept
+{
+    return static_cast<uint32_t>(time(nullptr) / g_tickets.period);
+}
+
+//! @brief Makes sure there's a key of revision due, taking the key file's keys first if there's
+//!        one; g_tickets.mtx is to be held
+void rotate(const uint32_t due) noexcept
+{
+    auto &ks = g_tickets.keys;
+    int fd   = -1;
+    if (g_tickets.file) {
+        fd = open(g_tickets.file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1 || flock(fd, LOCK_EX) == -1) { // the lock goes with closing
+            g_log.error("couldn't lock ticket key file: ", strerror(errno));
+        } else {
+            ticket_key buf[nticket_keys];
+            if (const auto nr = pread(fd, buf, sizeof(buf), 0); nr >= ssize_t{sizeof(ticket_key)})
+                ks.assign(buf, buf + static_cast<std::size_t>(nr) / sizeof(ticket_key));
+        }
+    }
+    DEFER[=] {
+        if (fd != -1) CHECK(close(fd), != -1);
+    };
+    if (!ks.empty() && ks.back().rev >= due) return g_tickets.newest.store(ks.back().rev);
+
+    auto &k = ks.emplace_back(due);
+    CHECK(getentropy(k.key, sizeof(k.key)), != -1);
+    if (ks.size() > nticket_keys) ks.erase(ks.begin());
+    g_tickets.newest.store(due);
+    if (fd != -1) {
+        const auto n = ks.size() * sizeof(ticket_key);
+        if (pwrite(fd, ks.data(), n, 0) != static_cast<ssize_t>(n) ||
+            ftruncate(fd, static_cast<off_t>(n)) == -1)
+            g_log.error("couldn't write ticket key file: ", strerror(errno));
+    }
+}
+} // namespace
+
+void tls_established(tls *const tc, const uint64_t since) noexcept
+{
+    g_handshakes.fetch_add(1, std::memory_order_relaxed);
+    if (tls_conn_session_resumed(tc) == 1) g_resumed.fetch_add(1, std::memory_order_relaxed);
+    g_handshake_us.fetch_add((mono_ns() - since) / 1000, std::memory_order_relaxed);
+}
+
+tls_stats tls_totals() noexcept
+{
+    return {.handshakes   = g_handshakes.load(std::memory_order_relaxed),
+            .resumed      = g_resumed.load(std::memory_order_relaxed),
+            .handshake_us = g_handshake_us.load(std::memory_order_relaxed)};
+}
+
+void tickets_start(const uint32_t lifetime, const char *const file)
+{
+    std::scoped_lock lk{g_tickets.mtx};
+    g_tickets.period = std::max(lifetime / 2, 1u); // so a key lasts at least 1.5 lifetimes
+    g_tickets.file   = file;
+    rotate(due_rev());
+}
+
+bool ticket_sync::configure() noexcept
+{
+    const auto cfg = tls_config_new();
+    if (!cfg) {
+        g_log.error("tls_config_new() failed");
+        return false;
+    }
+    DEFER[=] { tls_config_free(cfg); }; // ts holds a reference of its own
+
+    tls_config_set_cert_file(cfg, o->ssl_cert);
+    CHECK(tls_config_set_key_mem(cfg, key.data(), key.size()), != -1);
+    if (o->alpn) CHECK(tls_config_set_alpn(cfg, o->alpn), != -1);
+    if (o->session_lifetime) {
+        // the same session ID context everywhere, so that sessions resume on any reactor or process
+        const auto sid = reinterpret_cast<const unsigned char *>("pistonen");
+        CHECK(tls_config_set_session_id(cfg, sid, 8), != -1);
+        CHECK(tls_config_set_session_lifetime(cfg, static_cast<int>(o->session_lifetime)), != -1);
+        std::scoped_lock lk{g_tickets.mtx};
+        for (auto &k : g_tickets.keys) {
+            if (tls_config_add_ticket_key(cfg, k.rev, k.key, sizeof(k.key)) == -1)
+                g_log.error("tls_config_add_ticket_key() failed: ", tls_config_error(cfg));
+            rev = k.rev;
+        }
+    }
+    CHECK(tls_configure(ts, cfg), != -1);
+    return true;
+}
+
+void ticket_sync::sync() noexcept
+{
+    if (!g_tickets.period) return;
+    const auto due = due_rev();
+    if (const auto nw = g_tickets.newest.load(); nw >= due && rev == nw) [[likely]]
+        return;
+    {
+        std::scoped_lock lk{g_tickets.mtx};
+        if (g_tickets.keys.back().rev < due) rotate(due);
+    }
+    configure();
+}
 } // namespace pnen::detail
 
 [[nodiscard]] JUTIL_INLINE const std::string_view &mimetype_to_string(mimetype mt) noexcept
@@ -76,15 +472,131 @@ struct gc_res {
     const std::string_view &type = STATIC_SV(""), &hdr = STATIC_SV("");
 };
 
-[[nodiscard]] JUTIL_INLINE gc_res serve_api(const string &uri, buffer &body) noexcept
+//! @brief A response body to be sent straight from a file (see pnen::detail::file_transport)
+struct file_body {
+    int fd           = -1;
+    std::size_t size = 0;
+
+    file_body() = default;
+    NO_COPY_MOVE(file_body);
+    ~file_body() { reset(); }
+
+    void reset() noexcept
+    {
+        if (fd != -1) CHECK(close(fd), != -1), fd = -1;
+    }
+    [[nodiscard]] explicit operator bool() const noexcept { return fd != -1; }
+
+    //! @brief Opens the file at path, if it's large enough to be worth sending as is
+    bool open(const char *const path) noexcept
+    {
+        struct stat st;
+        if ((fd = ::open(path, O_RDONLY | O_CLOEXEC)) == -1) return false;
+        if (fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < SENDFILE_MIN) {
+            reset();
+            return false;
+        }
+        size = static_cast<std::size_t>(st.st_size);
+        return true;
+    }
+};
+
+//! @brief A response as a list of segments, which are sent in order without being concatenated:
+//!        the head, then the body's, each either borrowed (e.g., a static resource, which outlives
+//!        the response) or a view of what the response owns
+struct response {
+    buffer head;               // status line and header fields
+    buffer owned;              // body content made for this response
+    std::array<iovec, 4> segs; // [0] is the head's
+    std::size_t nsegs = 1;
+    std::size_t nbody = 0;           // bytes in the body segments
+    std::shared_ptr<const void> pin; // owner of what a borrowed segment refers to, if refcounted
+
+    pnen::generator<std::string_view> stream; // rest of the body, produced as it's being sent
+    std::size_t nstream = 0;                  // bytes stream produces, if known up front
+    bool chunked        = false;              // it's sent in chunked coding, nstream being unknown
+
+    static constexpr std::size_t unknown = SIZE_MAX;
+
+    //! @brief Appends sv to the body; it's to stay valid until the response has been sent
+    void borrow(const std::string_view sv) noexcept
+    {
+        if (sv.empty()) return;
+        CHECK(nsegs, < segs.size());
+        segs[nsegs++] = {const_cast<char *>(sv.data()), sv.size()};
+        nbody += sv.size();
+    }
+    //! @brief Appends sv to the body, keeping its owner alive until the response has been reset
+    //! @note Only one owner is kept; bodies borrow from at most one refcounted source
+    void borrow(const std::string_view sv, std::shared_ptr<const void> owner) noexcept
+    {
+        borrow(sv);
+        pin = std::move(owner);
+    }
+    //! @brief Appends what's been put into owned to the body; owned isn't to change afterwards
+    void own() noexcept { borrow({owned.data(), owned.size()}); }
+
+    //! @brief Has the body end with what g produces, each chunk being sent before the next is asked
+    //!        for, so that the body needn't fit in memory, nor wait to be complete to begin
+    //! @param n How many bytes g produces, or unknown
+    void produce(pnen::generator<std::string_view> g, const std::size_t n = unknown) noexcept
+    {
+        stream  = std::move(g);
+        nstream = n;
+    }
+    //! @return The length of the body, or unknown
+    [[nodiscard]] std::size_t length() const noexcept
+    {
+        return !stream ? nbody : nstream == unknown ? unknown : nbody + nstream;
+    }
+
+    //! @return The segments to be sent, which the sending advances in place
+    [[nodiscard]] std::span<iovec> gather() noexcept
+    {
+        segs[0] = {const_cast<char *>(head.data()), head.size()};
+        return {segs.data(), nsegs};
+    }
+    void reset() noexcept
+    {
+        head.reset();
+        owned.reset();
+        nsegs = 1;
+        nbody = 0;
+        pin.reset();
+        stream.reset();
+        chunked = false;
+    }
+};
+
+[[nodiscard]] JUTIL_INLINE gc_res serve_api(const string &uri, response &rs) noexcept
 {
     using namespace std::string_view_literals;
     if (uri == "vocabVer") {
-        body.put(std::string_view{"1"});
+        rs.borrow("1");
+        return {STATIC_SV("text/plain")};
+    }
+    if (uri == "stats") {
+        auto &body    = rs.owned;
+        const auto fs = pnen::detail::frame_pool::totals();
+        body.put("frame_pool_hits ", fs.hits, "\nframe_pool_misses ", fs.misses,
+                 "\nframe_pool_live ", fs.live, "\nframe_pool_cached ", fs.cached,
+                 "\nframe_pool_live_bytes ", fs.live_bytes, "\nframe_pool_slab_bytes ",
+                 fs.slab_bytes, "\n");
+        for (const auto &[name, pool] : {std::pair{"blocking", pnen::offload_pool::blocking},
+                                        std::pair{"handshake", pnen::offload_pool::handshake}}) {
+            const auto os = pnen::detail::offload_totals(pool);
+            body.append("offload_", name, "_queued ", os.queued, "\noffload_", name, "_jobs ",
+                        os.jobs, "\noffload_", name, "_wait_us ", os.wait_us, "\noffload_", name,
+                        "_run_us ", os.run_us, "\n");
+        }
+        const auto ts = pnen::detail::tls_totals(); // resumed ratio: resumed / handshakes
+        body.append("tls_handshakes ", ts.handshakes, "\ntls_resumed ", ts.resumed,
+                    "\ntls_handshake_us ", ts.handshake_us, "\n");
+        rs.own();
         return {STATIC_SV("text/plain")};
     }
     if (uri == "vocab") {
-        body.put(std::string_view{g_vocab.buf.get(), g_vocab.nbuf});
+        if (const auto v = g_vocab.get()) rs.borrow(v->sv(), v);
         return {STATIC_SV("text/plain"), STATIC_SV("content-encoding: gzip\r\n")};
     }
     return {};
@@ -117,16 +629,35 @@ static constexpr std::array dynamic{
 };
 } // namespace hdrs
 
-[[nodiscard]] JUTIL_INLINE gc_res get_content(const string &uri, buffer &body)
+//! @brief Produces n bytes of file fd in chunks of up to STREAM_CHUNK, closing it once done
+//! @note Stops short if the file turns out to have been truncated
+pnen::generator<std::string_view> read_chunks(const int fd, std::size_t n)
+{
+    DEFER[=] { CHECK(close(fd), != -1); };
+    const auto buf = std::make_unique_for_overwrite<char[]>(std::min<std::size_t>(n, STREAM_CHUNK));
+    for (off_t off = 0; n;) {
+        ssize_t ret;
+        while ((ret = pread(fd, buf.get(), std::min<std::size_t>(n, STREAM_CHUNK), off)) == -1 &&
+               errno == EINTR)
+            ;
+        if (ret <= 0) co_return;
+        off += ret;
+        n -= static_cast<std::size_t>(ret);
+        co_yield std::string_view{buf.get(), static_cast<std::size_t>(ret)};
+    }
+}
+
+//! @param file Where to open a large file to be sent with sendfile(); null if the transport can't
+[[nodiscard]] JUTIL_INLINE gc_res get_content(const string &uri, response &rs, file_body *file)
 {
     using namespace std::string_view_literals;
     if (uri.sv().starts_with("/api/")) {
         g_log.print("  serving api request: ", uri.sv());
-        return serve_api(uri.substr(5), body);
+        return serve_api(uri.substr(5), rs);
     }
     const auto mt = get_mimetype(uri);
     if (const auto idx = find_unrl_idx(res::names, uri); idx < res::names.size()) {
-        body.put(res::contents[idx]);
+        rs.borrow(res::contents[idx]);
         g_log.print("  serving static file: ", uri.sv());
         return {mimetype_to_string(mt), hdrs::static_[std::to_underlying(mt)]};
     }
@@ -134,9 +665,22 @@ static constexpr std::array dynamic{
     for (const auto &e :
          sf::recursive_directory_iterator{g_wwwroot} |
              sv::filter(L(x.is_regular_file() && x.path().filename() == fname, &))) {
+        if (file && file->open(e.path().c_str())) {
+            g_log.print("  serving dynamic file (sendfile): ", uri.sv());
+            return {mimetype_to_string(get_mimetype(uri)), hdrs::dynamic[std::to_underlying(mt)]};
+        }
+        // copied otherwise; on TLS always, as libtls can't hand its session keys to kTLS
+        if (const auto n = e.file_size(); n > STREAM_CHUNK) {
+            const auto fd = ::open(e.path().c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) break;
+            rs.produce(read_chunks(fd, n), n);
+            g_log.print("  serving dynamic file (streamed): ", uri.sv());
+            return {mimetype_to_string(get_mimetype(uri)), hdrs::dynamic[std::to_underlying(mt)]};
+        }
         FILE *f = fopen(e.path().c_str(), "rb");
         DEFER[=] { fclose(f); };
-        body.put(lazywrite(e.file_size(), L2(fread(x, 1, y, f), &)));
+        rs.owned.put(lazywrite(e.file_size(), L2(fread(x, 1, y, f), &)));
+        rs.own();
         // TODO: gzip-encoded contents
         g_log.print("  serving dynamic file: ", uri.sv());
         return {mimetype_to_string(get_mimetype(uri)), hdrs::dynamic[std::to_underlying(mt)]};
@@ -145,6 +689,13 @@ static constexpr std::array dynamic{
     return {};
 }
 
+//! @brief Whether serving rq may block on the filesystem, i.e., it's worth offloading
+[[nodiscard]] bool touches_fs(const message &rq) noexcept
+{
+    return rq.strt.mtd == method::GET && !rq.strt.tgt.sv().starts_with("/api/") &&
+           find_unrl_idx(res::names, rq.strt.tgt) == res::names.size();
+}
+
 constexpr std::string_view nf1 = "<!DOCTYPE html><meta charset=utf-8><title>Error 404 (Not "
                                  "Found)</title><p><b>404</b> Not Found.<p>The resource <code>",
                            nf2 = "</code> was not found.";
@@ -298,101 +849,1011 @@ bool check_auth(const std::string_view sv) noexcept
 
 // example: check_auth("Basic dXNlcm5hbWU6cGFzc3dvcmQ="); // checks username:password
 
+//
+// connection persistence
+//
+
+//! @brief Whether a comma-separated header value lists given (lowercase) token
+[[nodiscard]] bool has_token(const std::string_view v, const std::string_view tok) noexcept
+{
+    for (auto f = v.begin(); f != v.end();) {
+        const auto l = std::find(f, v.end(), ',');
+        const auto tf = std::find_if_not(f, l, L(x == ' ' || x == '\t'));
+        const auto tl = std::find_if_not(std::make_reverse_iterator(l),
+                                         std::make_reverse_iterator(tf), L(x == ' ' || x == '\t'))
+                            .base();
+        if (sr::equal(tf, tl, tok.begin(), tok.end(), {}, L(static_cast<char>(tolower(x)))))
+            return true;
+        f = l == v.end() ? l : l + 1;
+    }
+    return false;
+}
+
+//! @brief Whether the client lets the connection persist after rq (RFC 7230 section 6.3)
+[[nodiscard]] bool wants_keep_alive(const message &rq) noexcept
+{
+    const auto conn = rq.hdrs.get(field::connection, "");
+    return rq.strt.ver == version::http11 ? !has_token(conn, "close")
+                                          : has_token(conn, "keep-alive");
+}
+
+//! @brief The connection header(s) of a response
+struct conn_hdr {
+    unsigned nleft; // requests the client may still send; 0 = connection closes
+};
+
+constexpr std::string_view ka_hdr = "connection: keep-alive\r\nkeep-alive: "
+                                    "timeout=" BOOST_PP_STRINGIZE(KEEP_ALIVE_SECS) ", max=",
+                           cl_hdr = "connection: close\r\n";
+
+template <>
+struct format::formatter<conn_hdr> {
+    static char *format(char *d_f, const conn_hdr &c) noexcept
+    {
+        return c.nleft ? format::format(d_f, ka_hdr, c.nleft, "\r\n") : format::format(d_f, cl_hdr);
+    }
+    static std::size_t maxsz(const conn_hdr &c) noexcept
+    {
+        return format::maxsz(ka_hdr, c.nleft, "\r\n");
+    }
+};
+
+//! @brief The header telling how the body of a response is delimited; none if it's delimited by
+//!        the connection closing
+struct length_hdr {
+    std::size_t n; // length of the body, or response::unknown
+    bool chunked;  // with n unknown, the body is sent with chunked coding
+};
+
+constexpr std::string_view cl_hdr_name = "content-length: ",
+                           te_hdr      = "transfer-encoding: chunked\r\n";
+
+template <>
+struct format::formatter<length_hdr> {
+    static char *format(char *d_f, const length_hdr &l) noexcept
+    {
+        if (l.n != response::unknown) return format::format(d_f, cl_hdr_name, l.n, "\r\n");
+        return l.chunked ? format::format(d_f, te_hdr) : d_f;
+    }
+    static std::size_t maxsz(const length_hdr &l) noexcept
+    {
+        return format::maxsz(cl_hdr_name, l.n, "\r\n") + te_hdr.size();
+    }
+};
+
+//
+// request bodies
+//
+
+//! @brief What the route of a request does with its body
+enum class body_use : uint8_t {
+    none,   // takes none; one sent anyway isn't read, and the connection closes after the response
+    buffer, // takes it whole, as message::body, if it fits in BODY_BUFFER_MAX
+    stream, // takes it a span at a time as it's read, however large
+};
+
+//! @brief What's become of the body of a request
+enum class body_state : uint8_t {
+    unread,     // not read (there may have been none)
+    read,       // read to its end
+    too_large,  // larger than its route takes (413)
+    malformed,  // not delimited as RFC 7230 section 3.3.3 has it (400)
+    unexpected, // with an expectation other than 100-continue (417)
+};
+
+//! @brief The body of a request, and what its route has taken of it
+struct request_body {
+    static constexpr auto chunked = SIZE_MAX; // the length of a body in chunked coding
+
+    std::size_t length = 0; // content-length, or chunked
+    body_use use       = body_use::none;
+    body_state st      = body_state::unread;
+    bool cont          = false; // the client waits for 100 Continue before sending the body
+    std::size_t n      = 0;     // bytes taken
+    std::string_view whole;     // body_use::buffer: what's been taken, in buf or as it was read
+    std::string buf;
+    uint64_t digest = 0xcbf29ce484222325; // body_use::stream: 64-bit FNV-1a of what's been taken
+
+    //! @brief Takes the next span of the body
+    //! @return Whether the route takes it, i.e., the body isn't too large
+    bool take(const std::string_view sv) noexcept
+    {
+        n += sv.size();
+        if (use == body_use::stream) {
+            for (const auto c : sv)
+                digest = (digest ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+            return true;
+        }
+        if (n > BODY_BUFFER_MAX) return false;
+        if (n == length && sv.size() == n) return whole = sv, true; // came whole; no need to copy
+        buf.append(sv);
+        whole = buf;
+        return true;
+    }
+    //! @return Whether the connection is still framed after the request, i.e., there was no body
+    //!         or it was read to its end
+    [[nodiscard]] bool framed() const noexcept
+    {
+        return st == body_state::read || (st == body_state::unread && !length);
+    }
+    void reset() noexcept
+    {
+        length = 0;
+        use    = body_use::none;
+        st     = body_state::unread;
+        cont   = false;
+        n      = 0;
+        whole  = {};
+        std::string{}.swap(buf);
+        digest = 0xcbf29ce484222325;
+    }
+};
+
+//! @brief What the route of rq does with a body
+[[nodiscard]] body_use body_use_of(const message &rq) noexcept
+{
+    const auto m = rq.strt.mtd;
+    const auto t = rq.strt.tgt.sv();
+    if (m == method::POST && t == "/api/echo") return body_use::buffer;
+    if ((m == method::POST || m == method::PUT) && t == "/api/sink") return body_use::stream;
+    return body_use::none;
+}
+
+//! @brief Whether a header value is given (lowercase) token and nothing else
+[[nodiscard]] bool is_token(const std::string_view v, const std::string_view tok) noexcept
+{
+    return has_token(v, tok) && v.find(',') == std::string_view::npos;
+}
+
+//! @brief Finds out how the body of rq is delimited, and whether its route is to read it
+void admit(const message &rq, request_body &b) noexcept
+{
+    const auto &h = rq.hdrs;
+    // a content-length or transfer-encoding that's repeated, or given along with the other, may
+    // have been taken differently by a proxy in front, which would let requests be smuggled
+    if (sr::any_of(h, L(x.first == "content-length" || x.first == "transfer-encoding")) ||
+        (h.has(field::content_length) && h.has(field::transfer_encoding)))
+        return void(b.st = body_state::malformed);
+    if (h.has(field::transfer_encoding)) {
+        // no coding but chunked is supported, and HTTP/1.0 has none
+        if (rq.strt.ver != version::http11 || !is_token(h.get(field::transfer_encoding), "chunked"))
+            return void(b.st = body_state::malformed);
+        b.length = request_body::chunked;
+    } else if (h.has(field::content_length)) {
+        auto v = h.get(field::content_length);
+        v      = v.substr(0, v.find_last_not_of(" \t") + 1);
+        if (const auto [p, ec] = std::from_chars(v.data(), v.data() + v.size(), b.length);
+            v.empty() || ec != std::errc{} || p != v.data() + v.size() ||
+            b.length == request_body::chunked)
+            return void(b.st = body_state::malformed);
+    }
+    if (rq.strt.ver == version::http11 && h.has(field::expect)) { // HTTP/1.0 has no expectations
+        if (!is_token(h.get(field::expect), "100-continue"))
+            return void(b.st = body_state::unexpected);
+        b.cont = true;
+    }
+    if (!b.length) return;
+    const auto use = body_use_of(rq);
+    if (use == body_use::none || !check_auth(h.get(field::authorization, ""))) return;
+    if (use == body_use::buffer && b.length != request_body::chunked && b.length > BODY_BUFFER_MAX)
+        return void(b.st = body_state::too_large);
+    b.use = use;
+}
+
+//! @brief Reads the body of a request, handing it to body.take() as it arrives
+//! @param next What's been read past the request header; left as what's been read past the body,
+//!        i.e., of the next request
+//! @param bb Where the rest of the body is read into, the header's buffer being left as it is
+//! @return Whether the connection can go on, i.e., didn't fail; body.st tells how far the body was
+//!         read
+template <pnen::transport T>
+pnen::subtask<bool> read_body(pnen::socket<T> &s, request_body &body, std::span<char> &next,
+                              std::optional<pooled_buffer> &bb)
+{
+    chunked_decoder dec;
+    auto left          = body.length; // unless in chunked coding
+    const auto chunked = body.length == request_body::chunked;
+    const auto waiting = body.cont && next.empty(); // if some of it came along, the client didn't
+    for (;;) {
+        const char *f = next.data(), *const l = f + next.size();
+        while (f != l) {
+            std::string_view sv;
+            if (chunked) {
+                if (sv = dec.next(f, l); dec.bad()) co_return body.st = body_state::malformed, true;
+            } else {
+                sv = {f, std::min(left, static_cast<std::size_t>(l - f))};
+                f += sv.size();
+                left -= sv.size();
+            }
+            if (!sv.empty() && !body.take(sv)) co_return body.st = body_state::too_large, true;
+            if (chunked ? dec.done() : !left) {
+                next = {const_cast<char *>(f), const_cast<char *>(l)};
+                co_return body.st = body_state::read, true;
+            }
+        }
+        if (!bb) {
+            if (waiting) {
+                FOR_CO_AWAIT (s.write("HTTP/1.1 100 Continue\r\n\r\n"))
+                    ;
+                else co_return false;
+            }
+            bb.emplace();
+            while (bb->capacity() < BODY_READ_CHUNK && bb->grow(0))
+                ;
+        }
+        FOR_CO_AWAIT (b, _, s.read_body(bb->data(), bb->capacity())) {
+            next = b;
+            break;
+        } else
+            co_return false;
+    }
+}
+
+//! @brief Reads past what the client may still be sending of a body that wasn't read, up to
+//!        LINGER_MAX bytes or until the client closes, for the connection to be closed cleanly
+//! @param buf Where to read into; what's read is discarded
+//! @note Closing a socket with unread bytes resets the connection, which may have the client
+//!       discard the response before reading it
+template <pnen::transport T>
+pnen::subtask<void> linger(pnen::socket<T> &s, pooled_buffer &buf)
+{
+    for (std::size_t n = 0; n < LINGER_MAX;) {
+        FOR_CO_AWAIT (b, _, s.read_body(buf.data(), buf.capacity())) {
+            n += b.size();
+            break;
+        } else
+            co_return;
+    }
+}
+
 //
 // request serving
 //
 
+//! @brief Has rs serve what a route took of a request body
+//! @return The content type of the response
+[[nodiscard]] std::string_view serve_body(const string &uri, const request_body &body,
+                                          response &rs) noexcept
+{
+    if (uri == "/api/echo") {
+        rs.borrow(body.whole);
+        return "application/octet-stream";
+    }
+    // /api/sink
+    char hex[16];
+    const auto l = std::to_chars(hex, hex + sizeof(hex), body.digest, 16).ptr;
+    rs.owned.put(body.n, " ", std::string_view{hex, l}, "\n"); // length and FNV-1a
+    rs.own();
+    return "text/plain; charset=UTF-8";
+}
+
 //! @brief Writes a response message serving a given request message
 //! @param rq Request message to serve
+//! @param body The body of rq, as far as it's been read
 //! @param rs Response message for given request
-void serve(const message &rq, buffer &rs, buffer &body)
+//! @param file Where a body to be sent after rs is opened; null if the transport can't sendfile()
+//! @param nleft How many more requests the connection may serve after rq
+//! @return Whether the connection is to be kept open for the next request
+bool serve(const message &rq, const request_body &body, response &rs, file_body *const file,
+           const unsigned nleft)
 {
-    if (rq.strt.mtd == method::err) goto badreq;
+    if (rq.strt.mtd == method::err || body.st == body_state::malformed) goto badreq;
     if (rq.strt.ver == version::err) goto badver;
+    if (body.st == body_state::unexpected) goto badexpect;
 
-    if (const auto auth = rq.hdrs.get("Authorization", ""); !check_auth(auth)) {
-        rs.put("HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Basic\r\n\r\n");
+    if (const conn_hdr conn{wants_keep_alive(rq) && body.framed() ? nleft : 0};
+        !check_auth(rq.hdrs.get(field::authorization, ""))) {
+        rs.head.put("HTTP/1.1 401 Unauthorized\r\nWWW-Authenticate: Basic\r\ncontent-length: 0\r\n",
+                    conn, "\r\n");
         g_log.print("  401 Unauthorized");
-        return;
-    }
-
+        return conn.nleft;
+    } else {
 #ifndef NDEBUG
-    if (rq.strt.tgt.sv() == "/kill") exit(0);
+        if (rq.strt.tgt.sv() == "/kill") exit(0);
 #endif
 
-    g_log.print("serving request: ", std::to_underlying(rq.strt.mtd), " ", rq.strt.tgt);
-    switch (rq.strt.mtd) {
-    case method::GET: {
-        if (const auto [type, hdr] = get_content(rq.strt.tgt, body); !type.empty()) {
-            g_log.print("  200 OK");
-            rs.put("HTTP/1.1 200 OK\r\nconnection: keep-alive\r\ncontent-type: ", type,
-                   "; charset=UTF-8\r\ndate: ", format::hdr_time{}, //
-                   "\r\ncontent-length: ", body.size(),
-                   "\r\nkeep-alive: timeout=" BOOST_PP_STRINGIZE(KEEP_ALIVE_SECS), //
-                       "\r\n", hdr,      //
-                       "\r\n", std::string_view{body.data(), body.size()});
-        } else {
-            g_log.print("  404 Not Found");
-            const escaped res = rq.strt.tgt.sv().substr(0, 100);
-            rs.put("HTTP/1.1 404 Not Found\r\n"
-                   "content-type: text/html; charset=UTF-8\r\n"
-                   "content-length:",
-                   nf1.size() + nf2.size() + res.size(), //
-                   "\r\ndate: ", format::hdr_time{},     //
-                   "\r\n\r\n", nf1, res, nf2);
+        g_log.print("serving request: ", std::to_underlying(rq.strt.mtd), " ", rq.strt.tgt);
+        switch (rq.strt.mtd) {
+        case method::GET: {
+            if (const auto [type, hdr] = get_content(rq.strt.tgt, rs, file); !type.empty()) {
+                g_log.print("  200 OK");
+                // without chunked coding (HTTP/1.0), a body of unknown length is delimited by the
+                // connection closing
+                auto c       = conn;
+                const auto n = file && *file ? file->size : rs.length();
+                if (n == response::unknown && !(rs.chunked = rq.strt.ver == version::http11))
+                    c.nleft = 0;
+                rs.head.put("HTTP/1.1 200 OK\r\n", c, "content-type: ", type,
+                            "; charset=UTF-8\r\ndate: ", format::hdr_time{}, //
+                            "\r\n", length_hdr{n, rs.chunked}, hdr, "\r\n");
+                return c.nleft;
+            } else {
+                g_log.print("  404 Not Found");
+                const escaped res = rq.strt.tgt.sv().substr(0, 100);
+                rs.head.put("HTTP/1.1 404 Not Found\r\n", conn,
+                            "content-type: text/html; charset=UTF-8\r\n"
+                            "content-length:",
+                            nf1.size() + nf2.size() + res.size(), //
+                            "\r\ndate: ", format::hdr_time{},     //
+                            "\r\n\r\n", nf1, res, nf2);
+            }
+            return conn.nleft;
+        }
+        case method::POST:
+        case method::PUT: {
+            if (body_use_of(rq) == body_use::none) break;
+            if (body.st == body_state::too_large) {
+                g_log.print("  413 Payload Too Large");
+                rs.head.put("HTTP/1.1 413 Payload Too Large\r\nconnection: close\r\n"
+                            "content-length: 0\r\n\r\n");
+                return false;
+            }
+            const auto type = serve_body(rq.strt.tgt, body, rs);
+            g_log.print("  200 OK (", body.n, " body bytes)");
+            rs.head.put("HTTP/1.1 200 OK\r\n", conn, "content-type: ", type, "\r\ndate: ",
+                        format::hdr_time{}, "\r\n", length_hdr{rs.length(), false}, "\r\n");
+            return conn.nleft;
+        }
+        default:;
         }
-        return;
-    }
-    default:;
     }
 badreq:
     g_log.print("  400 Bad Request");
-    rs.put("400 Bad Request\r\n\r\n\r\n");
-    return;
+    rs.head.put("HTTP/1.1 400 Bad Request\r\nconnection: close\r\ncontent-length: 0\r\n\r\n");
+    return false;
 badver:
     g_log.print("  505 HTTP Version Not Supported");
-    rs.put("505 HTTP Version Not Supported\r\n\r\n\r\n");
+    rs.head.put("HTTP/1.1 505 HTTP Version Not Supported\r\nconnection: close\r\n"
+                "content-length: 0\r\n\r\n");
+    return false;
+badexpect:
+    g_log.print("  417 Expectation Failed");
+    rs.head.put("HTTP/1.1 417 Expectation Failed\r\nconnection: close\r\n"
+                "content-length: 0\r\n\r\n");
+    return false;
 }
 
-DBGSTMNT(static int ncon = 0;)
+DBGSTMNT(static std::atomic_int ncon = 0;)
 
-pnen::task handle_connection(pnen::socket s)
+//! @brief Sends what rs.stream produces, in chunked coding if rs.chunked
+//! @param blocking Whether producing may block, in which case it's done on the offload pool
+//! @return Whether the body was sent as the header said it would be, i.e., the connection may
+//!         persist
+template <pnen::transport T>
+pnen::subtask<bool> send_stream(pnen::socket<T> &s, response &rs, const bool blocking)
+{
+    std::size_t n = 0;
+    while (const auto chunk = blocking ? co_await pnen::offload(L0(rs.stream.next(), &))
+                                       : rs.stream.next()) {
+        if (chunk->empty()) continue; // would end chunked coding
+        n += chunk->size();
+        if (rs.chunked) {
+            char sz[sizeof(std::size_t) * 2 + 2];
+            const auto l = std::to_chars(sz, sz + sizeof(sz) - 2, chunk->size(), 16).ptr;
+            memcpy(l, "\r\n", 2);
+            iovec v[]{{sz, static_cast<std::size_t>(l + 2 - sz)},
+                      {const_cast<char *>(chunk->data()), chunk->size()},
+                      {const_cast<char *>("\r\n"), 2}};
+            FOR_CO_AWAIT (s.write(v))
+                ;
+            else co_return false;
+        } else {
+            FOR_CO_AWAIT (s.write(*chunk))
+                ;
+            else co_return false;
+        }
+    }
+    if (!rs.chunked) co_return n == rs.nstream;
+    FOR_CO_AWAIT (s.write("0\r\n\r\n"))
+        ;
+    else co_return false;
+    co_return true;
+}
+
+//
+// HTTP/2
+//
+
+//! @brief A request of an HTTP/2 connection, and its response
+struct h2_stream {
+    uint32_t id;
+    int64_t window;  // response bytes the client takes before it sends a WINDOW_UPDATE
+    std::string hdr; // the request header in HTTP/1.1 form, which rq refers into
+    message rq;
+    request_body body;
+    std::size_t declared = request_body::chunked; // the body's content-length, if it was given
+    response rs;
+    bool complete = false;                 // the request has arrived whole
+    bool served   = false;                 // rs has been written, and its HEADERS queued
+    bool ended    = false;                 // the frame ending the stream has been queued
+    bool fs       = false;                 // serving may block (see touches_fs())
+    bool cut      = false;                 // the rest of the request is discarded (see on_data())
+    std::array<std::string_view, 4> parts; // what's left to send of the body, but for rs.stream
+    std::size_t npart = 0, ipart = 0;
+
+    h2_stream(const uint32_t id_, const int64_t window_) noexcept : id{id_}, window{window_} {}
+    NO_COPY_MOVE(h2_stream);
+
+    //! @brief Takes the request header from its fields as h2::decoder::decode() gives them
+    //! @param end Whether the request has no body
+    //! @return Whether the request was well-formed, i.e., had a method and a path, its
+    //!         pseudo-header fields before the others, and no content-length but 0 if it's to have
+    //!         no body
+    bool open(std::string_view fields, const bool end)
+    {
+        std::string_view mtd, path, authority;
+        while (fields.starts_with(':')) {
+            const auto eol  = fields.find("\r\n");
+            const auto line = fields.substr(0, eol);
+            const auto sep  = line.find(": ");
+            if (const auto name = line.substr(0, sep), value = line.substr(sep + 2);
+                name == ":method")
+                mtd = value;
+            else if (name == ":path")
+                path = value;
+            else if (name == ":authority")
+                authority = value;
+            else if (name != ":scheme")
+                return false;
+            fields.remove_prefix(eol + 2);
+        }
+        if (mtd.empty() || path.empty() || mtd.find(' ') != std::string_view::npos ||
+            path.find(' ') != std::string_view::npos ||
+            fields.find("\r\n:") != std::string_view::npos)
+            return false;
+        hdr.append(mtd).append(" ").append(path).append(" HTTP/1.1\r\n");
+        if (!authority.empty()) hdr.append("host: ").append(authority).append("\r\n");
+        hdr.append(fields).append("\r\n");
+        parse_header(hdr.data(), hdr.data() + hdr.size() - 4, rq);
+        fs = touches_fs(rq);
+
+        // DATA frames delimit the body, and a content-length given is to agree with them (RFC
+        // 9113, 8.1.1); being taken as frames arrive, the body is never whole in one, so take() is
+        // to copy it rather than refer to it
+        body.length = end ? 0 : request_body::chunked;
+        admit(rq, body);
+        if (end) return !body.length && finish();
+        declared    = body.length;
+        body.length = request_body::chunked;
+        return true;
+    }
+
+    //! @brief Accounts for the request having arrived whole
+    //! @return Whether the body was as long as its content-length said, if it was given
+    [[nodiscard]] bool finish() noexcept
+    {
+        complete = true;
+        if (body.use != body_use::none && body.st == body_state::unread) body.st = body_state::read;
+        return declared == request_body::chunked || body.n == declared;
+    }
+};
+
+//! @brief An HTTP/2 connection but for its socket: frames that arrive are handed to take(), and
+//!        the ones to be sent in response come from gather()
+struct h2_conn {
+    h2::decoder dec;
+    std::vector<std::unique_ptr<h2_stream>> streams; // open ones, in the order they were opened
+    std::string ctl;                                 // frames to be sent ahead of any DATA
+    std::string block;                               // header block being received
+    uint32_t block_sid    = 0;                       // its stream, while CONTINUATIONs are due
+    uint8_t block_flags   = 0;                       // its HEADERS frame's
+    uint32_t last_sid     = 0;                       // of the stream the client opened last
+    int64_t window        = h2::default_window;      // response bytes the connection takes
+    int64_t init_window   = h2::default_window;      // of streams, as the client set it
+    std::size_t max_frame = h2::default_frame_size;  // as the client set it
+    bool closing          = false;                   // the client sent GOAWAY
+    h2::error_code err    = h2::error_code::no_error; // what failed the connection
+
+    std::array<std::array<char, h2::frame_header_size>, 64> fhs; // of the DATA frames in iov
+    std::array<iovec, 1 + 2 * std::tuple_size_v<decltype(fhs)>> iov;
+
+    h2_conn()
+    {
+        char p[12] = {0, static_cast<char>(h2::setting::max_concurrent_streams)};
+        h2::frame_header::write_u32(p + 2, H2_MAX_STREAMS);
+        p[6] = 0, p[7] = static_cast<char>(h2::setting::max_header_list_size);
+        h2::frame_header::write_u32(p + 8, H2_MAX_LIST);
+        frame(h2::frame_type::settings, 0, 0, {p, sizeof(p)});
+    }
+
+    //! @brief Takes in the frames in [f:l) that have arrived whole
+    //! @return How much of [f:l) was taken; the rest is the start of a frame
+    //! @note Once err is set, the connection is to be closed after sending what's queued
+    std::size_t take(const char *f, const char *l);
+
+    //! @brief Queues the response of st, which has been written
+    void respond(h2_stream &st);
+
+    //! @brief Puts the frames to be sent next in iov: the queued ones, then DATA of each stream in
+    //!        turn, a frame at a time, as far as flow control lets them
+    //! @return How many of iov are used; none if there's nothing to send
+    std::size_t gather() noexcept;
+
+    //! @brief Accounts for what gather() put in iov having been sent
+    void sent()
+    {
+        ctl.clear();
+        for (const auto &st : streams)
+            if (st->ended && st->cut)
+                frame(h2::frame_type::rst_stream, st->id,
+                      std::to_underlying(h2::error_code::no_error));
+        std::erase_if(streams, L(x->ended));
+    }
+
+  private:
+    void frame(h2::frame_type t, uint8_t flags, uint32_t sid, std::string_view payload);
+    //! @brief Queues a frame whose payload is a 32-bit value, e.g. WINDOW_UPDATE
+    void frame(const h2::frame_type t, const uint32_t sid, const uint32_t x)
+    {
+        char p[4];
+        h2::frame_header::write_u32(p, x);
+        frame(t, 0, sid, {p, sizeof(p)});
+    }
+    void fail(h2::error_code e);
+
+    [[nodiscard]] h2_stream *find(const uint32_t sid) const noexcept
+    {
+        const auto it = sr::find(streams, sid, L(x->id));
+        return it == streams.end() ? nullptr : it->get();
+    }
+    void drop(const h2_stream *const st) { std::erase_if(streams, L(x.get() == st, &)); }
+
+    void on_frame(const h2::frame_header &fh, std::string_view pl);
+    void on_data(const h2::frame_header &fh, std::string_view pl);
+    void on_headers(const h2::frame_header &fh, std::string_view pl);
+    void on_settings(const h2::frame_header &fh, std::string_view pl);
+    void on_window_update(const h2::frame_header &fh, std::string_view pl);
+};
+
+void h2_conn::frame(const h2::frame_type t, const uint8_t flags, const uint32_t sid,
+                    const std::string_view payload)
+{
+    char fh[h2::frame_header_size];
+    h2::frame_header{static_cast<uint32_t>(payload.size()), t, flags, sid}.write(fh);
+    ctl.append(fh, sizeof(fh)).append(payload);
+}
+
+void h2_conn::fail(const h2::error_code e)
+{
+    if (err != h2::error_code::no_error) return;
+    err = e;
+    char p[8];
+    h2::frame_header::write_u32(h2::frame_header::write_u32(p, last_sid), std::to_underlying(e));
+    frame(h2::frame_type::goaway, 0, 0, {p, sizeof(p)});
+}
+
+std::size_t h2_conn::take(const char *const f, const char *const l)
+{
+    auto p = f;
+    while (err == h2::error_code::no_error &&
+           static_cast<std::size_t>(l - p) >= h2::frame_header_size) {
+        const auto fh = h2::frame_header::read(p);
+        if (fh.length > h2::default_frame_size) { // SETTINGS_MAX_FRAME_SIZE is left at that
+            fail(h2::error_code::frame_size_error);
+            break;
+        }
+        if (static_cast<std::size_t>(l - p) < h2::frame_header_size + fh.length) break;
+        p += h2::frame_header_size;
+        on_frame(fh, {p, fh.length});
+        p += fh.length;
+    }
+    return static_cast<std::size_t>(p - f);
+}
+
+void h2_conn::on_frame(const h2::frame_header &fh, const std::string_view pl)
+{
+    using enum h2::frame_type;
+    using enum h2::error_code;
+    if (block_sid && (fh.type != continuation || fh.sid != block_sid)) return fail(protocol_error);
+    switch (fh.type) {
+    case data: return on_data(fh, pl);
+    case headers:
+    case continuation: return on_headers(fh, pl);
+    case rst_stream:
+        if (!fh.sid || fh.sid > last_sid) return fail(protocol_error);
+        if (pl.size() != 4) return fail(frame_size_error);
+        return drop(find(fh.sid));
+    case settings: return on_settings(fh, pl);
+    case push_promise: return fail(protocol_error); // clients don't push
+    case ping:
+        if (fh.sid) return fail(protocol_error);
+        if (pl.size() != 8) return fail(frame_size_error);
+        if (!(fh.flags & h2::flag::ack)) frame(ping, h2::flag::ack, 0, pl);
+        return;
+    case goaway: closing = true; return;
+    case window_update: return on_window_update(fh, pl);
+    default: return; // PRIORITY, which is advisory, and unknown types are ignored
+    }
+}
+
+void h2_conn::on_data(const h2::frame_header &fh, std::string_view pl)
+{
+    using enum h2::error_code;
+    if (!fh.sid || fh.sid > last_sid) return fail(protocol_error);
+    if (fh.flags & h2::flag::padded) {
+        if (pl.empty() || static_cast<uint8_t>(pl[0]) >= pl.size()) return fail(protocol_error);
+        pl = pl.substr(1, pl.size() - 1 - static_cast<uint8_t>(pl[0]));
+    }
+    const auto end = static_cast<bool>(fh.flags & h2::flag::end_stream);
+    // what a frame took of the connection's window, padding and all, is given back right away:
+    // it's either taken by a body, which holds no more than BODY_BUFFER_MAX of it, or discarded
+    if (fh.length) frame(h2::frame_type::window_update, 0, fh.length);
+    const auto st = find(fh.sid);
+    if (!st || st->complete) { // closed, or cut; what's still on the way is discarded
+        if (st && end) st->cut = false;
+        return;
+    }
+    if (auto &b = st->body; b.use != body_use::none) {
+        if (pl.empty() || b.take(pl)) {
+            // only what the body took is given back of the stream's window, so that a client
+            // sending one that isn't taken is held back
+            if (!end) {
+                if (fh.length) frame(h2::frame_type::window_update, fh.sid, fh.length);
+            } else if (!st->finish()) {
+                frame(h2::frame_type::rst_stream, fh.sid, std::to_underlying(protocol_error));
+                drop(st);
+            }
+            return;
+        }
+        b.st = body_state::too_large;
+    }
+    // the rest of the body isn't taken, so the response needn't wait for it; the stream is reset
+    // once the response has been sent, unless the client has ended it by then (RFC 9113, 8.1)
+    st->complete = true;
+    st->cut      = !end;
+}
+
+void h2_conn::on_headers(const h2::frame_header &fh, std::string_view pl)
+{
+    using enum h2::error_code;
+    if (fh.type == h2::frame_type::headers) {
+        if (!(fh.sid & 1)) return fail(protocol_error); // client streams are odd, 0 excluded
+        if (fh.flags & h2::flag::padded) {
+            if (pl.empty() || static_cast<uint8_t>(pl[0]) >= pl.size())
+                return fail(protocol_error);
+            pl = pl.substr(1, pl.size() - 1 - static_cast<uint8_t>(pl[0]));
+        }
+        if (fh.flags & h2::flag::priority) {
+            if (pl.size() < 5) return fail(protocol_error);
+            pl.remove_prefix(5);
+        }
+        block.clear();
+        block_flags = fh.flags;
+    } else if (!block_sid) {
+        return fail(protocol_error);
+    }
+    if (block.size() + pl.size() > H2_MAX_BLOCK) return fail(enhance_your_calm);
+    block.append(pl);
+    if (!(fh.flags & h2::flag::end_headers)) return void(block_sid = fh.sid);
+    block_sid = 0;
+
+    // the block is decoded whatever becomes of the stream, for the decoder to keep in sync
+    std::string fields;
+    const auto e   = dec.decode(block, fields, H2_MAX_LIST);
+    const auto end = static_cast<bool>(block_flags & h2::flag::end_stream);
+    if (e == compression_error) return fail(e);
+    if (const auto st = find(fh.sid)) { // trailers, which are to end the stream, and are ignored
+        if (st->cut && end) return void(st->cut = false);
+        if (st->complete || !end || !st->finish()) {
+            frame(h2::frame_type::rst_stream, fh.sid, std::to_underlying(protocol_error));
+            drop(st);
+        }
+        return;
+    }
+    // trailers of a stream that was reset may still be on the way
+    if (fh.sid <= last_sid) return end ? void() : fail(stream_closed);
+    last_sid = fh.sid;
+    if (closing || streams.size() >= H2_MAX_STREAMS)
+        return frame(h2::frame_type::rst_stream, fh.sid, std::to_underlying(refused_stream));
+    auto st = std::make_unique<h2_stream>(fh.sid, init_window);
+    if (e != no_error || !st->open(fields, end))
+        return frame(h2::frame_type::rst_stream, fh.sid,
+                     std::to_underlying(e == enhance_your_calm ? e : protocol_error));
+    streams.push_back(std::move(st));
+}
+
+void h2_conn::on_settings(const h2::frame_header &fh, const std::string_view pl)
+{
+    using enum h2::error_code;
+    if (fh.sid) return fail(protocol_error);
+    if (fh.flags & h2::flag::ack) return pl.empty() ? void() : fail(frame_size_error);
+    if (pl.size() % 6) return fail(frame_size_error);
+    for (std::size_t i = 0; i < pl.size(); i += 6) {
+        const auto id = static_cast<uint16_t>(static_cast<uint8_t>(pl[i]) << 8 |
+                                              static_cast<uint8_t>(pl[i + 1]));
+        const auto v  = h2::frame_header::read_u32(pl.data() + i + 2);
+        switch (static_cast<h2::setting>(id)) {
+        case h2::setting::enable_push:
+            if (v > 1) return fail(protocol_error);
+            break;
+        case h2::setting::initial_window_size:
+            if (v > h2::max_window) return fail(flow_control_error);
+            // open streams' windows change by as much as the initial one did
+            for (const auto &st : streams)
+                st->window += v - init_window;
+            init_window = v;
+            break;
+        case h2::setting::max_frame_size:
+            if (v < h2::default_frame_size || v > 0xffffff) return fail(protocol_error);
+            max_frame = v;
+            break;
+        default:; // the rest don't concern a server that doesn't push
+        }
+    }
+    frame(h2::frame_type::settings, h2::flag::ack, 0, {});
+}
+
+void h2_conn::on_window_update(const h2::frame_header &fh, const std::string_view pl)
+{
+    using enum h2::error_code;
+    if (pl.size() != 4) return fail(frame_size_error);
+    const auto inc = h2::frame_header::read_u32(pl.data()) & h2::max_window;
+    if (!fh.sid) {
+        if (!inc) return fail(protocol_error);
+        if ((window += inc) > h2::max_window) return fail(flow_control_error);
+        return;
+    }
+    const auto st = find(fh.sid);
+    if (!st) return; // closed; ones sent before it was are still on the way
+    if (!inc || (st->window += inc) > h2::max_window) {
+        frame(h2::frame_type::rst_stream, fh.sid,
+              std::to_underlying(inc ? flow_control_error : protocol_error));
+        drop(st);
+    }
+}
+
+void h2_conn::respond(h2_stream &st)
+{
+    const auto segs = st.rs.gather();
+    const std::string_view head{static_cast<const char *>(segs[0].iov_base), segs[0].iov_len};
+    std::string blk;
+    const auto nhead = h2::encode_head(head, blk);
+    if (nhead != head.size()) st.parts[st.npart++] = head.substr(nhead); // a small body, e.g. 404
+    for (const auto &v : segs.subspan(1))
+        st.parts[st.npart++] = {static_cast<const char *>(v.iov_base), v.iov_len};
+    st.served = true;
+    st.ended  = !st.npart && !st.rs.stream;
+
+    // HEADERS, and CONTINUATION frames for what doesn't fit in it
+    auto t = h2::frame_type::headers;
+    for (std::string_view b = blk;; t = h2::frame_type::continuation) {
+        const auto n    = std::min(b.size(), max_frame);
+        const auto last = n == b.size();
+        const auto end  = t == h2::frame_type::headers && st.ended;
+        frame(t, static_cast<uint8_t>((last ? h2::flag::end_headers : 0) |
+                                      (end ? h2::flag::end_stream : 0)),
+              st.id, b.substr(0, n));
+        if (last) break;
+        b.remove_prefix(n);
+    }
+}
+
+std::size_t h2_conn::gather() noexcept
+{
+    std::size_t n = 0, nfh = 0, total = 0;
+    if (!ctl.empty()) iov[n++] = {ctl.data(), ctl.size()};
+    const auto skip = [](h2_stream &st) {
+        while (st.ipart != st.npart && st.parts[st.ipart].empty())
+            ++st.ipart;
+    };
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (const auto &p : streams) {
+            auto &st = *p;
+            if (!st.served || st.ended || nfh == fhs.size() || total >= H2_WRITE_MAX) continue;
+            skip(st);
+            std::string_view chunk;
+            if (st.ipart != st.npart) {
+                const auto m = std::min({st.parts[st.ipart].size(), max_frame,
+                                         static_cast<std::size_t>(
+                                             std::max<int64_t>(0, std::min(st.window, window)))});
+                if (!m) continue;
+                chunk = st.parts[st.ipart].substr(0, m);
+                st.parts[st.ipart].remove_prefix(m);
+                st.window -= static_cast<int64_t>(m);
+                window -= static_cast<int64_t>(m);
+                total += m;
+                skip(st);
+            } else if (st.rs.stream) {
+                continue; // for it to produce more
+            }
+            st.ended = st.ipart == st.npart && !st.rs.stream;
+            auto &fh = fhs[nfh++];
+            h2::frame_header{static_cast<uint32_t>(chunk.size()), h2::frame_type::data,
+                             st.ended ? h2::flag::end_stream : uint8_t{}, st.id}
+                .write(fh.data());
+            iov[n++] = {fh.data(), fh.size()};
+            if (!chunk.empty()) iov[n++] = {const_cast<char *>(chunk.data()), chunk.size()};
+            progress = true;
+        }
+    }
+    return n;
+}
+
+//! @brief Serves an HTTP/2 connection, each of its streams as serve() does a request
+//! @param rb What's been read of the connection, nread bytes, e.g. the start of its preface
+template <pnen::transport T>
+pnen::subtask<void> serve_h2(pnen::socket<T> &s, pooled_buffer &rb, std::size_t nread)
+{
+    h2_conn c;
+    // a frame of the largest size taken fits, along with the start of the next
+    while (rb.capacity() <= h2::frame_header_size + h2::default_frame_size && rb.grow(nread))
+        ;
+    while (nread < h2::preface.size()) {
+        FOR_CO_AWAIT (b, _, s.read(rb.data(), rb.capacity(), nread)) {
+            nread = b.size();
+            break;
+        } else
+            co_return;
+    }
+    if (std::string_view{rb.data(), h2::preface.size()} != h2::preface) co_return;
+    auto off = h2::preface.size(); // bytes of rb taken in
+    for (;;) {
+        // Take in the frames that have arrived whole, and keep the start of the next
+        off += c.take(rb.data() + off, rb.data() + nread);
+        memmove(rb.data(), rb.data() + off, nread -= off);
+        off = 0;
+        if (c.err != h2::error_code::no_error) {
+            FOR_CO_AWAIT (s.write(c.ctl))
+                ;
+            co_return;
+        }
+
+        // Serve the requests that have arrived whole
+        for (const auto &p : c.streams) {
+            auto &st = *p;
+            if (!st.complete || st.served) continue;
+            st.rq.body = {const_cast<char *>(st.body.whole.data()), st.body.whole.size()};
+            if (st.fs)
+                co_await pnen::offload(L0(serve(st.rq, st.body, st.rs, nullptr, 0), &));
+            else
+                serve(st.rq, st.body, st.rs, nullptr, 0);
+            c.respond(st);
+        }
+
+        // Have the bodies produced as they're sent that have run dry produce more, if there's
+        // window for it
+        for (const auto &p : c.streams) {
+            auto &st = *p;
+            if (!st.served || st.ended || !st.rs.stream || st.window <= 0 || c.window <= 0 ||
+                sr::any_of(std::span{st.parts}.subspan(st.ipart, st.npart - st.ipart),
+                           L(!x.empty())))
+                continue;
+            if (const auto chunk = st.fs ? co_await pnen::offload(L0(st.rs.stream.next(), &))
+                                         : st.rs.stream.next())
+                st.parts[0] = *chunk, st.npart = 1, st.ipart = 0;
+            else
+                st.rs.stream.reset();
+        }
+
+        // Send what can be; what's arrived meanwhile is taken in before going on
+        if (const auto n = c.gather()) {
+            FOR_CO_AWAIT (s.write(std::span{c.iov.data(), n}))
+                ;
+            else co_return;
+            c.sent();
+            if (const auto ret = s.try_read(rb.data() + nread, rb.capacity() - nread); ret > 0)
+                nread += static_cast<std::size_t>(ret);
+            else if (ret == 0 || ret == -1)
+                co_return;
+            continue;
+        }
+        if (c.closing && c.streams.empty()) co_return;
+
+        // Nothing can be sent until more frames arrive
+        FOR_CO_AWAIT (b, _,
+                      c.streams.empty() ? s.read(rb.data(), rb.capacity(), nread)
+                                        : s.read_body(rb.data(), rb.capacity(), nread)) {
+            nread = b.size();
+            break;
+        } else
+            co_return;
+    }
+}
+
+template <pnen::transport T>
+pnen::task handle_connection(pnen::socket<T> s)
 {
     DBGEXPR(const int id_ = ncon++);
     DBGEXPR(printf("con#%d: accepted\n", id_));
     DBGEXPR(DEFER[=] { printf("con#%d: write end\n", id_); });
 
-    // Read into buffer
-    static constexpr size_t nbuf = 8 * 1024 * 1024;
-    char buf[nbuf];
+    pooled_buffer rb; // grows only as much as a request header needs
+    size_t nread = 0; // bytes in rb; beyond the current request, they're pipelined ones
     message rq;
-    FOR_CO_AWAIT (b, rs, s.read(buf, nbuf)) {
-        const auto [it, _] = sr::search(b, std::string_view{"\r\n\r\n"});
-        if (it == b.end()) {
-            if (rs.nbufspn == 0) {
-                FOR_CO_AWAIT (s.write("431 Request Header Fields Too Large\r\n\r\n"))
+    request_body body;
+    response rs;
+    file_body file; // the body when it's to be sent with sendfile()
+    if constexpr (pnen::handshake_transport<T>)
+        if (!co_await pnen::handshake(s)) co_return;
+    if constexpr (pnen::alpn_transport<T>) {
+        if (s.t.alpn() == "h2") {
+            co_await serve_h2(s, rb, 0);
+            co_return;
+        }
+    }
+    for (unsigned nleft = KEEP_ALIVE_MAX; nleft--;) {
+        // Read into buffer until the end of header (CRLFCRLF) is in it; each scan resumes where
+        // the last one left off, so that a header trickling in isn't scanned over and over
+        const std::string_view crlf2{"\r\n\r\n"};
+        char *eoh;
+        for (size_t scanned = 0;
+             (eoh = find_crlf2(rb.data() + scanned, rb.data() + nread)) == rb.data() + nread;) {
+            scanned = nread < 3 ? 0 : nread - 3;
+            if (nread == rb.capacity() && !rb.grow(nread)) {
+                FOR_CO_AWAIT (s.write("HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                                      "connection: close\r\ncontent-length: 0\r\n\r\n"))
                     ;
                 co_return;
             }
-        } else { // end of header (CRLFCRLF)
-            parse_header(buf, &*it, rq);
-            break;
+            FOR_CO_AWAIT (b, _, s.read(rb.data(), rb.capacity(), nread)) {
+                nread = b.size();
+                break;
+            } else
+                co_return;
         }
-    } else
-        co_return;
-
-    // Handle request & build response
-    DBGEXPR(printf("vvv con#%d: received message with the header:\n", id_));
-    DBGEXPR(print_header(rq));
-    DBGEXPR(printf("^^^\n"));
-    // TODO: read rq body
-    // determining message length (after CRLFCRLF):
-    // https://www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.4
-    buffer rs;
-    buffer rs_body;
-    serve(rq, rs, rs_body);
-
-    // Write response
-    FOR_CO_AWAIT (s.write(rs.data(), rs.size()))
-        ;
+        // over plaintext, a client that knows HTTP/2 is spoken opens with its preface, whose first
+        // line and CRLFCRLF read like a request header; over TLS, ALPN alone decides
+        if (!pnen::alpn_transport<T> && nleft == KEEP_ALIVE_MAX - 1 &&
+            std::string_view{rb.data(), nread}.starts_with(h2::preface.substr(0, 18))) {
+            co_await serve_h2(s, rb, nread);
+            co_return;
+        }
+        parse_header(rb.data(), eoh, rq);
+
+        // Handle request & build response
+        DBGEXPR(printf("vvv con#%d: received message with the header:\n", id_));
+        DBGEXPR(print_header(rq));
+        DBGEXPR(printf("^^^\n"));
+        // Read the body if its route takes it; the rest of the body of one it doesn't isn't read,
+        // and the connection closes after the response
+        std::span<char> next{eoh + crlf2.size(), rb.data() + nread}; // read past the request
+        std::optional<pooled_buffer> bb; // what the body's read into past what came with the header
+        admit(rq, body);
+        if (body.use != body_use::none && !co_await read_body(s, body, next, bb)) co_return;
+        rq.body = {const_cast<char *>(body.whole.data()), body.whole.size()};
+        const auto nf   = pnen::file_transport<T> ? &file : nullptr;
+        const auto fs   = touches_fs(rq); // may block, so it's done off the reactor
+        const auto keep = fs ? co_await pnen::offload(L0(serve(rq, body, rs, nf, nleft), &))
+                             : serve(rq, body, rs, nf, nleft);
+
+        // Write response; with a file or stream to follow, the header can share its first segment
+        FOR_CO_AWAIT (s.write(rs.gather(), file || rs.stream))
+            ;
+        else co_return;
+        if constexpr (pnen::file_transport<T>) {
+            if (file) {
+                FOR_CO_AWAIT (s.sendfile(file.fd, 0, file.size))
+                    ;
+                else co_return;
+                file.reset();
+            }
+        }
+        if (rs.stream && !co_await send_stream(s, rs, fs)) co_return;
+        if (!keep) {
+            if (!body.framed()) co_await linger(s, rb);
+            co_return;
+        }
+
+        // Move what's been read of the next request to the front, and let go of memory only this
+        // request needed
+        nread = next.size();
+        if (bb) {
+            rb.shrink(0);
+            while (rb.capacity() < nread)
+                rb.grow(0);
+        }
+        memmove(rb.data(), next.data(), nread);
+        rb.shrink(nread);
+        rs.reset();
+        body.reset();
+    }
 }
+
+template pnen::task handle_connection(pnen::socket<pnen::tcp_transport>);
+template pnen::task handle_connection(pnen::socket<pnen::tls_transport>);
+template pnen::task handle_connection(pnen::socket<pnen::mem_transport>);
+template pnen::task handle_connection(pnen::socket<pnen::mem_alpn_transport>);
+#ifdef PNEN_IO_URING
+template pnen::task handle_connection(pnen::socket<pnen::uring_transport>);
+#endif
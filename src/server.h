@@ -2,4 +2,5 @@
 
 #include "pistonen.h"
 
-pnen::task handle_connection(pnen::socket s);
+template <pnen::transport T>
+pnen::task handle_connection(pnen::socket<T> s);
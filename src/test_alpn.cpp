@@ -0,0 +1,86 @@
+// Protocol selection: opens connections over in-memory transports, some with a handshake that
+// negotiates a protocol as TLS with ALPN does, and has each client open with the HTTP/2 preface.
+// Fails if a connection that negotiated h2 isn't served HTTP/2 once its handshake completes, if one
+// that negotiated otherwise is, or if one without a handshake (plaintext) isn't served HTTP/2 for
+// the preface alone.
+//
+// usage: test_alpn
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string_view>
+
+#include "h2.h"
+#include "server.h"
+#include "vocabserv.h"
+
+detail::log g_log;
+detail::vocab g_vocab;
+const char *g_wwwroot = ".";
+
+namespace
+{
+//! @brief Whether what the server sent starts the way HTTP/2 is served, i.e., with its SETTINGS
+bool sent_settings(const std::string_view out)
+{
+    return out.size() >= h2::frame_header_size &&
+           h2::frame_header::read(out.data()).type == h2::frame_type::settings;
+}
+
+struct client {
+    pnen::mem_pipe in, out;
+    void *h = nullptr;
+
+    //! @brief Sends data, and has the server take it in
+    void send(const std::string_view data)
+    {
+        in.data.append(data);
+        pnen::task::promise_type::wake(h);
+    }
+    //! @brief Goes away, the server following
+    //! @return Whether the server did
+    bool close()
+    {
+        in.closed = true;
+        pnen::task::promise_type::wake(h);
+        return out.closed;
+    }
+};
+
+//! @param proto The protocol negotiated, if the connection has a handshake that negotiates one
+//! @param want_h2 Whether it's to be served HTTP/2
+bool check(pnen::detail::timer_wheel &tw, const char *const proto, const bool want_h2)
+{
+    auto hc = [](auto s) { return handle_connection(std::move(s)); };
+    client c;
+    auto ok = true;
+    if (proto) {
+        c.h = pnen::connect_mem<pnen::mem_alpn_transport>(hc, c.in, c.out, tw, proto).address();
+        ok &= c.out.data.empty() && !c.out.closed; // waiting for the client to start the handshake
+        c.send("H");                               // the ClientHello
+    } else {
+        c.h = pnen::connect_mem(hc, c.in, c.out, tw).address();
+    }
+    c.send(h2::preface);
+    const auto served_h2 = sent_settings(c.out.data);
+    ok &= served_h2 == want_h2 && (want_h2 || c.out.data.starts_with("HTTP/1.1 "));
+    printf("  %-11s %s\n", !proto ? "(plaintext)" : *proto ? proto : "(none)",
+           served_h2 ? "HTTP/2" : "HTTP/1.1");
+    return c.close() && ok;
+}
+} // namespace
+
+int main()
+{
+    g_log.file = CHECK(fopen("/dev/null", "w"), != nullptr);
+    pnen::run_server_options o{};
+    pnen::detail::timer_wheel tw{pnen::detail::deadline_ms(o)};
+
+    printf("protocol negotiated, protocol served:\n");
+    auto ok = check(tw, "h2", true);
+    ok &= check(tw, "http/1.1", false); // the preface is no request, and is answered as one
+    ok &= check(tw, "", false);         // the client offered no protocols
+    ok &= check(tw, nullptr, true);     // plaintext, where the preface tells of HTTP/2
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
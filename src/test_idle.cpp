@@ -0,0 +1,77 @@
+// Idle connection footprint: opens connections over in-memory transports, lets each of them wait
+// for a request, and reports the memory they hold, per connection. Fails if that's more than the
+// budget of an idle connection, or if closing them doesn't give all of it back.
+//
+// usage: test_idle [connections=1000]
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "server.h"
+#include "vocabserv.h"
+
+detail::log g_log;
+detail::vocab g_vocab;
+const char *g_wwwroot = ".";
+
+namespace
+{
+constexpr std::size_t budget = 32 * 1024; // bytes an idle connection may hold
+
+struct footprint {
+    uint64_t frames; // bytes of coroutine frames
+    uint64_t slabs;  // bytes of frame_pool slabs, cached frames included
+    uint64_t bufs;   // bytes of pooled_buffer blocks held
+    uint64_t heap;   // bytes allocated in all, the above included
+
+    [[nodiscard]] static footprint now() noexcept
+    {
+        const auto fs = pnen::detail::frame_pool::totals();
+        const auto mi = mallinfo2();
+        return {fs.live_bytes, fs.slab_bytes, detail::pool_totals().held, mi.uordblks + mi.hblkhd};
+    }
+};
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const auto n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000ul;
+
+    g_log.file = CHECK(fopen("/dev/null", "w"), != nullptr);
+    pnen::run_server_options o{};
+    pnen::detail::timer_wheel tw{pnen::detail::deadline_ms(o)};
+    auto hc = [](auto s) { return handle_connection(std::move(s)); };
+    std::vector<pnen::mem_pipe> ins(n), outs(n);
+    std::vector<void *> hs;
+    hs.reserve(n);
+
+    const auto a = footprint::now();
+    for (std::size_t i = 0; i < n; ++i)
+        hs.push_back(pnen::connect_mem(hc, ins[i], outs[i], tw).address());
+    const auto b   = footprint::now();
+    const auto per = [&](const uint64_t x, const uint64_t y) {
+        return static_cast<double>(y - x) / static_cast<double>(n);
+    };
+    printf("%lu idle connections, bytes per connection:\n", n);
+    printf("  coroutine frames %9.1f\n", per(a.frames, b.frames));
+    printf("  frame_pool slabs %9.1f\n", per(a.slabs, b.slabs));
+    printf("  pooled buffers   %9.1f\n", per(a.bufs, b.bufs));
+    printf("  heap in all      %9.1f (budget %zu)\n", per(a.heap, b.heap), budget);
+    auto ok = per(a.heap, b.heap) <= budget;
+
+    // the peers going away has them return to the pools what they held
+    for (std::size_t i = 0; i < n; ++i) {
+        ins[i].closed = true;
+        pnen::task::promise_type::wake(hs[i]);
+    }
+    const auto c = footprint::now();
+    for (std::size_t i = 0; i < n; ++i)
+        ok &= outs[i].closed;
+    ok &= c.frames == a.frames && c.bufs == a.bufs;
+    printf("after closing: coroutine frames %+ld, pooled buffers %+ld\n",
+           static_cast<long>(c.frames - a.frames), static_cast<long>(c.bufs - a.bufs));
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
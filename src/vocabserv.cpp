@@ -53,7 +53,7 @@ int main(int argc, char **argv)
     using options::help;
     using options::strs;
     try {
-        static pnen::run_server_options opts{};
+        static pnen::run_server_options opts{.alpn = "h2,http/1.1"};
 
         static constexpr auto ov = options::make_visitor([](const std::string_view sv) {
             fprintf(stderr, "unknown argument '%.*s'\n", static_cast<int>(sv.size()), sv.data());
@@ -91,6 +91,72 @@ int main(int argc, char **argv)
              [](const std::string_view pkey) { opts.ssl_pkey = pkey.data(); }) //
             (strs("-pkpass", "P")(help, "Give pkey password, or 'prompt' for interactive prompt."),
              [](const std::string_view pass) { opts.pk_pass = pass.data(); }) //
+            (strs("-session-lifetime")(help, "Set how long TLS sessions can be resumed for, in s."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%u", &opts.session_lifetime) != 1) {
+                     fprintf(stderr, "couldn't read session lifetime as int (\"%s\")", sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-ticket-keys")(help, "Set path to file to share TLS ticket keys through."),
+             [](const std::string_view path) { opts.ticket_keys = path.data(); }) //
+            (strs("-threads", "t")(help, "Set the number of reactor threads (0 = one per CPU)."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%u", &opts.nreactors) != 1) {
+                     fprintf(stderr, "couldn't read thread count as int (\"%s\")", sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-pin-cpus")(help, "Pin each reactor thread to its own CPU."),
+             [] { opts.pin_cpus = true; }) //
+            (strs("-backlog", "b")(help, "Set the listen backlog of each reactor."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%d", &opts.backlog) != 1) {
+                     fprintf(stderr, "couldn't read backlog as int (\"%s\")", sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-accept-budget")(help, "Set max accepts per listener wakeup (0 = unlimited)."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%u", &opts.accept_budget) != 1) {
+                     fprintf(stderr, "couldn't read accept budget as int (\"%s\")", sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-offload-threads")(help, "Set the number of blocking-call workers (0 = none)."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%u", &opts.offload_threads) != 1) {
+                     fprintf(stderr, "couldn't read offload thread count as int (\"%s\")",
+                             sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-handshake-threads")(help, "Set the number of TLS handshake workers."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%u", &opts.handshake_threads) != 1) {
+                     fprintf(stderr, "couldn't read handshake thread count as int (\"%s\")",
+                             sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-resume-budget")(help, "Set bytes per turn of a connection (0 = no limit)."),
+             [](const std::string_view sv) {
+                 if (sscanf(sv.data(), "%u", &opts.resume_budget) != 1) {
+                     fprintf(stderr, "couldn't read resume budget as int (\"%s\")", sv.data());
+                     return 1;
+                 }
+                 return 0;
+             }) //
+            (strs("-no-http2")(help, "Don't offer HTTP/2 to TLS clients, only HTTP/1.1."),
+             [] { opts.alpn = nullptr; }) //
+            (strs("-io-uring")(help, "Use the io_uring event loop instead of epoll."),
+             [] { opts.backend = pnen::io_backend::io_uring; }) //
             ("vocabserv", "program for serving a static vocabulary listing");
 
         if (const auto res = options::visit(argc, argv, ov, options::default_visitor)) return res;
@@ -99,8 +165,9 @@ int main(int argc, char **argv)
         if (opts.pk_pass && strcmp(opts.pk_pass, "prompt") == 0)
             opts.pk_pass = get_pass(pwbuf, "Enter PEM pass phrase:");
 
-        DBGEXPR(printf("server will run on https://localhost:%hu...\n", opts.hostport));
-        pnen::run_server(opts, handle_connection);
+        DBGEXPR(printf("server will run on %s://localhost:%hu...\n",
+                       opts.ssl_cert ? "https" : "http", opts.hostport));
+        pnen::run_server(opts, [](auto s) { return handle_connection(std::move(s)); });
 
         return 0;
     } catch (const std::exception &e) {
@@ -117,8 +184,9 @@ bool detail::vocab::init(const char *path)
     fseek(file, 0, SEEK_END);
     const auto sz = static_cast<std::size_t>(ftell(file));
     fseek(file, 0, SEEK_SET);
-    buf  = std::make_unique_for_overwrite<char[]>(sz);
-    nbuf = fread(buf.get(), sizeof(char), sz, file);
+    auto d  = std::make_shared<data>(std::make_unique_for_overwrite<char[]>(sz), 0);
+    d->nbuf = fread(d->buf.get(), sizeof(char), sz, file);
+    cur.store(std::move(d), std::memory_order_release);
     return true;
 }
 
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <filesystem>
 #include <memory>
 #include <mutex>
+#include <string_view>
 
 #include "buffer.h"
 #include "jutil.h"
@@ -11,9 +13,24 @@
 namespace detail
 {
 struct vocab {
+    //! @brief The contents of a vocab file; immutable once loaded
+    struct data {
+        std::unique_ptr<char[]> buf;
+        std::size_t nbuf;
+        [[nodiscard]] std::string_view sv() const noexcept { return {buf.get(), nbuf}; }
+    };
+
+    //! @brief Loads the file at path, replacing the current contents; responses still being sent
+    //!        keep what they refer to alive
     bool init(const char *path);
-    std::unique_ptr<char[]> buf;
-    std::size_t nbuf;
+
+    //! @return The current contents, or null if none have been loaded
+    [[nodiscard]] std::shared_ptr<const data> get() const noexcept
+    {
+        return cur.load(std::memory_order_acquire);
+    }
+
+    std::atomic<std::shared_ptr<const data>> cur;
 };
 
 struct log {